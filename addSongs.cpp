@@ -4,12 +4,22 @@
 #include <string>
 #include <iostream>
 #include <unordered_map>
-#include <header/fingerprint.h>
-#include <header/spectogram.h>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <header/pipeline.h>
+#include <header/queue.h>
 #include <header/mongo.h>
-#include <header/mp3.h>
+#include <header/audio.h>
 
 
+const size_t FINGERPRINT_BATCH_SIZE = 1 << 16;
+
 
 bool ProcessAndSaveSong(const std::string& songFilePath, const std::string& songTitle, const std::string& songArtist) {
     try {
@@ -18,31 +28,77 @@ bool ProcessAndSaveSong(const std::string& songFilePath, const std::string& song
             throw std::runtime_error("Database connection failed.");
         }
 
-        auto [samples, sampleRate, channels, duration] = decodeMP3ToFloat(songFilePath);
-        if (samples.empty()) {
-            throw std::runtime_error("Error converting MP3 bytes to samples.");
-        }
-
-        auto spectrogram = Spectrogram(samples, sampleRate); 
-        if (spectrogram.empty()) {
-            throw std::runtime_error("Error creating spectrogram.");
+        std::unique_ptr<AudioDecoder> decoder = OpenAudioDecoder(songFilePath);
+        if (!decoder) {
+            throw std::runtime_error("Error decoding audio file.");
         }
 
         uint32_t songID = db->RegisterSong(songTitle, songArtist);
-        std::vector<Peak> peaks = ExtractPeaks(spectrogram, duration); 
-        if (peaks.empty()) {
-            throw std::runtime_error("No peaks found in spectrogram.");
+        if (songID == 0) {
+            throw std::runtime_error("Failed to register song.");
         }
 
-        auto fingerprints = Fingerprint(peaks, songID); 
-        if (fingerprints.empty()) {
-            throw std::runtime_error("Failed to generate fingerprints.");
-        }
+        // Decoded blocks go straight into the pipeline and fingerprints are
+        // stored in batches, so memory does not grow with the length of the
+        // track. The addresses of every batch are kept so a failure can take
+        // the stored couples back out along with the song.
+        std::vector<FingerprintHash> fingerprints;
+        std::vector<uint32_t> storedAddresses;
+        auto storeBatch = [&]() {
+            for (const FingerprintHash& hash : fingerprints) {
+                storedAddresses.push_back(hash.address);
+            }
+            bool stored = db->StoreFingerprints(songID, fingerprints);
+            fingerprints.clear();
+            return stored;
+        };
+        bool abandoned = false;
+        auto abandon = [&](const std::string& message) {
+            abandoned = true;
+            if (!storedAddresses.empty() && !db->DeleteFingerprints(songID, storedAddresses)) {
+                std::cerr << "Could not remove the stored fingerprints of song " << songID << std::endl;
+            }
+            db->DeleteSongByID(songID);
+            return std::runtime_error(message);
+        };
 
-        bool success = db->StoreFingerprints(fingerprints);
-        if (!success) {
-            db->DeleteSongByID(songID);  
-            throw std::runtime_error("Failed to store fingerprints in database.");
+        try {
+            FingerprintPipeline pipeline(static_cast<int>(decoder->SampleRate()),
+                [&](const FingerprintHash& hash) {
+                    fingerprints.push_back(hash);
+                });
+
+            bool success = true;
+            bool decoded = decoder->Decode([&](const double* block, size_t count) {
+                pipeline.Push(block, count);
+                if (fingerprints.size() >= FINGERPRINT_BATCH_SIZE) {
+                    success = storeBatch();
+                }
+                return success;
+            });
+            if (!decoded) {
+                throw abandon("Error decoding audio file.");
+            }
+            pipeline.Finish();
+            if (success && !fingerprints.empty()) {
+                success = storeBatch();
+            }
+
+            if (pipeline.Frames() == 0) {
+                throw abandon("Error creating spectrogram.");
+            }
+            if (pipeline.Peaks() == 0) {
+                throw abandon("No peaks found in spectrogram.");
+            }
+            if (pipeline.Couples() == 0) {
+                throw abandon("Failed to generate fingerprints.");
+            }
+            if (!success) {
+                throw abandon("Failed to store fingerprints in database.");
+            }
+        } catch (const std::exception& e) {
+            if (abandoned) throw;
+            throw abandon(e.what());
         }
 
         return true;
@@ -54,9 +110,233 @@ bool ProcessAndSaveSong(const std::string& songFilePath, const std::string& song
 }
 
 
+struct IngestJob {
+    std::string path;
+    std::string title;
+    std::string artist;
+};
+
+// Fingerprints of one decoded track; the song ID comes from the writer stage
+struct FingerprintedTrack {
+    IngestJob job;
+    std::vector<FingerprintHash> fingerprints;
+};
+
+struct IngestStats {
+    std::atomic<size_t> succeeded{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<int64_t> decodeNs{0};
+    std::atomic<int64_t> fingerprintNs{0};
+    std::atomic<int64_t> storeNs{0};
+};
+
+using IngestClock = std::chrono::steady_clock;
+
+static int64_t elapsedNs(IngestClock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(IngestClock::now() - start).count();
+}
+
+
+// Manifest lines are "path<TAB>title<TAB>artist"; blank lines and # comments are
+// skipped. A directory is walked recursively, using the file name as the title
+// and the parent directory as the artist. Unreadable subdirectories are
+// skipped; an error that stops the walk returns false after the jobs found so
+// far have been emitted.
+bool EnumerateJobs(const std::string& source, const std::function<bool(IngestJob)>& emit) {
+    std::error_code error;
+    if (fs::is_directory(source, error)) {
+        const std::vector<std::string> extensions = {".mp3", ".wav", ".flac", ".ogg", ".aiff", ".aif", ".m4a", ".aac", ".opus"};
+        try {
+            fs::recursive_directory_iterator it(source, fs::directory_options::skip_permission_denied, error);
+            for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+                const fs::directory_entry& entry = *it;
+                std::error_code statusError;
+                if (!entry.is_regular_file(statusError)) continue;
+                std::string extension = entry.path().extension().string();
+                std::transform(extension.begin(), extension.end(), extension.begin(),
+                               [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+                if (std::find(extensions.begin(), extensions.end(), extension) == extensions.end()) continue;
+
+                IngestJob job{entry.path().string(), entry.path().stem().string(),
+                              entry.path().parent_path().filename().string()};
+                if (!emit(std::move(job))) return false;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error walking " << source << ": " << e.what() << std::endl;
+            return false;
+        }
+        if (error) {
+            std::cerr << "Error walking " << source << ": " << error.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::ifstream manifest(source);
+    if (!manifest) {
+        std::cerr << "Cannot open manifest: " << source << std::endl;
+        return false;
+    }
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        IngestJob job;
+        std::istringstream fields(line);
+        if (!std::getline(fields, job.path, '\t') || !std::getline(fields, job.title, '\t') ||
+            !std::getline(fields, job.artist, '\t')) {
+            std::cerr << "Skipping malformed manifest line " << lineNumber << std::endl;
+            continue;
+        }
+        if (!emit(std::move(job))) return false;
+    }
+    return true;
+}
+
+
+void FingerprintWorker(BoundedQueue<IngestJob>& jobs, BoundedQueue<FingerprintedTrack>& tracks, IngestStats& stats) {
+    DspWorkspace workspace;
+    while (std::optional<IngestJob> job = jobs.Pop()) {
+        auto start = IngestClock::now();
+        int64_t pipelineNs = 0;
+
+        // One bad file (an unsupported rate, a decoder exception, running out
+        // of memory) fails its own job, not the worker and the whole batch
+        FingerprintedTrack track{std::move(*job), {}};
+        bool decoded = false;
+        try {
+            std::unique_ptr<AudioDecoder> decoder = OpenAudioDecoder(track.job.path);
+            if (decoder) {
+                FingerprintPipeline pipeline(static_cast<int>(decoder->SampleRate()),
+                    [&](const FingerprintHash& hash) {
+                        track.fingerprints.push_back(hash);
+                    }, nullptr, &workspace);
+                decoded = decoder->Decode([&](const double* block, size_t count) {
+                    auto pushStart = IngestClock::now();
+                    pipeline.Push(block, count);
+                    pipelineNs += elapsedNs(pushStart);
+                    return true;
+                });
+                auto finishStart = IngestClock::now();
+                pipeline.Finish();
+                pipelineNs += elapsedNs(finishStart);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error processing song: " << track.job.path << " (" << e.what() << ")" << std::endl;
+            stats.failed++;
+            continue;
+        }
+
+        stats.fingerprintNs += pipelineNs;
+        stats.decodeNs += elapsedNs(start) - pipelineNs;
+
+        if (!decoded || track.fingerprints.empty()) {
+            std::cerr << "Error processing song: " << track.job.path
+                      << (decoded ? " (no fingerprints)" : " (decode failed)") << std::endl;
+            stats.failed++;
+            continue;
+        }
+        if (!tracks.Push(std::move(track))) return;
+    }
+}
+
+
+// Registers each track and stores its fingerprints. Song IDs are allocated
+// atomically by the backend, so several writers can run side by side.
+void WriterStage(BoundedQueue<FingerprintedTrack>& tracks, DBClient& db, IngestStats& stats) {
+    while (std::optional<FingerprintedTrack> track = tracks.Pop()) {
+        auto start = IngestClock::now();
+
+        uint32_t songID = db.RegisterSong(track->job.title, track->job.artist);
+        if (songID == 0) {
+            std::cerr << "Error registering song: " << track->job.path << std::endl;
+            stats.failed++;
+            stats.storeNs += elapsedNs(start);
+            continue;
+        }
+
+        if (db.StoreFingerprints(songID, track->fingerprints)) {
+            stats.succeeded++;
+        } else {
+            // Some bulk writes may have gone through before the failure
+            std::vector<uint32_t> addresses;
+            addresses.reserve(track->fingerprints.size());
+            for (const FingerprintHash& hash : track->fingerprints) {
+                addresses.push_back(hash.address);
+            }
+            db.DeleteFingerprints(songID, addresses);
+            db.DeleteSongByID(songID);
+            std::cerr << "Failed to store fingerprints for: " << track->job.path << std::endl;
+            stats.failed++;
+        }
+        stats.storeNs += elapsedNs(start);
+    }
+}
+
+
+bool RunBatchIngest(const std::string& source, unsigned workers) {
+    std::unique_ptr<DBClient> db = NewDBClient();
+    if (!db->Connect()) {
+        std::cerr << "Error processing song: Database connection failed." << std::endl;
+        return false;
+    }
+
+    auto start = IngestClock::now();
+    IngestStats stats;
+    BoundedQueue<IngestJob> jobs(workers * 4);
+    BoundedQueue<FingerprintedTrack> tracks(workers * 2);
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < workers; i++) {
+        pool.emplace_back(FingerprintWorker, std::ref(jobs), std::ref(tracks), std::ref(stats));
+    }
+    std::vector<std::thread> writers;
+    for (unsigned i = 0; i < std::max(1u, workers / 2); i++) {
+        writers.emplace_back(WriterStage, std::ref(tracks), std::ref(*db), std::ref(stats));
+    }
+
+    bool enumerated = EnumerateJobs(source, [&](IngestJob job) { return jobs.Push(std::move(job)); });
+
+    jobs.Close();
+    for (auto& thread : pool) thread.join();
+    tracks.Close();
+    for (auto& thread : writers) thread.join();
+
+    double seconds = elapsedNs(start) / 1e9;
+    size_t total = stats.succeeded + stats.failed;
+    std::cout << "Ingested " << stats.succeeded << "/" << total << " tracks in " << seconds << " seconds ("
+              << (seconds > 0 ? stats.succeeded / seconds : 0.0) << " tracks/sec, " << workers << " workers)" << std::endl;
+    if (total > 0) {
+        std::cout << "  decode:      " << stats.decodeNs / 1e9 << " s total, " << stats.decodeNs / 1e6 / total << " ms/track" << std::endl;
+        std::cout << "  fingerprint: " << stats.fingerprintNs / 1e9 << " s total, " << stats.fingerprintNs / 1e6 / total << " ms/track" << std::endl;
+        std::cout << "  db write:    " << stats.storeNs / 1e9 << " s total, " << stats.storeNs / 1e6 / total << " ms/track" << std::endl;
+    }
+    for (const auto& [name, value] : db->Metrics()) {
+        std::cout << "  " << name << ": " << value << std::endl;
+    }
+
+    return enumerated && stats.failed == 0;
+}
+
+
 int main(int argc, char** argv) {
+    if (argc >= 3 && std::string(argv[1]) == "--batch") {
+        unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+        if (argc == 5 && std::string(argv[3]) == "--workers") {
+            workers = static_cast<unsigned>(std::max(1, std::atoi(argv[4])));
+        } else if (argc != 3) {
+            std::cerr << "Usage: ./add --batch <manifest.tsv | directory> [--workers N]" << std::endl;
+            return 1;
+        }
+        return RunBatchIngest(argv[2], workers) ? 0 : 1;
+    }
+
     if (argc != 4) {
         std::cerr << "Usage: ./add <songFilePath> <songTitle> <songArtist>" << std::endl;
+        std::cerr << "       ./add --batch <manifest.tsv | directory> [--workers N]" << std::endl;
         return 1;
     }
 
@@ -5,9 +5,13 @@ import subprocess
 import sounddevice as sd
 import scipy.io.wavfile as wav
 import pandas as pd
+import requests
 from pymongo import MongoClient
 
 
+SERVER_URL = os.environ.get("SHAZAM_SERVER_URL", "http://127.0.0.1:8080")
+
+
 def fetch_songs():
     try:
         client = MongoClient("mongodb://localhost:27017")  
@@ -35,16 +39,25 @@ def record_audio(duration=13, sample_rate=44100):
      sd.wait()
      temp_wav = tempfile.NamedTemporaryFile(delete=False, suffix=".wav")
      wav.write(temp_wav.name, sample_rate, audio_data)
-     temp_mp3 = temp_wav.name.replace(".wav", ".mp3")
-     subprocess.run(["ffmpeg", "-i", temp_wav.name, "-q:a", "2", temp_mp3], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
- 
-     os.remove(temp_wav.name) 
-     return temp_mp3
+     return temp_wav.name
      
 
 def find_song(audio_path):
-    result = subprocess.run(["build/shazam", audio_path], capture_output=True, text=True)
-    return result.returncode, result.stdout  
+    # Ask the long-lived shazam-server first; fall back to one process per search
+    try:
+        ext = os.path.splitext(audio_path)[1].lstrip(".") or "wav"
+        with open(audio_path, "rb") as f:
+            response = requests.post(f"{SERVER_URL}/match", params={"ext": ext}, data=f, timeout=60)
+        if response.status_code != 200:
+            return 1, response.text
+        matches = response.json()["matches"]
+        if not matches:
+            return 1, "No match found."
+        best = matches[0]
+        return 0, f"Best Match: {best['title']} by {best['artist']}"
+    except requests.exceptions.ConnectionError:
+        result = subprocess.run(["build/shazam", audio_path], capture_output=True, text=True)
+        return result.returncode, result.stdout  
 
 
 def add_song(file_path, song_name, artist_name):
@@ -109,12 +122,12 @@ with tab1:
 
 with tab2:
     st.subheader("Add a New Song")
-    song_file = st.file_uploader("Upload an MP3 file to add", type=["mp3"], key="add_song")
+    song_file = st.file_uploader("Upload an audio file to add", type=["mp3", "wav", "flac", "ogg", "m4a"], key="add_song")
     song_name = st.text_input("Enter Song Name")
     artist_name = st.text_input("Enter Artist Name")
 
     if song_file and song_name and artist_name:
-        with tempfile.NamedTemporaryFile(delete=False, suffix=".mp3") as temp_song:
+        with tempfile.NamedTemporaryFile(delete=False, suffix=os.path.splitext(song_file.name)[1]) as temp_song:
             temp_song.write(song_file.read())
             temp_song_path = temp_song.name
 
@@ -1,6 +1,77 @@
 #include <header/client.h>
 #include <header/mongo.h>
+#include <header/memory.h>
+#include <header/indexfile.h>
+#include <header/sharded.h>
+#include <header/utils.h>
+#include <sstream>
 
+// Copies the Mongo collections into in-memory shards: songs go to the first
+// shard, couples to the shard that owns their address
+static bool loadFromMongo(std::vector<MemoryClient*>& memory) {
+    MongoClient mongo;
+    if (!mongo.Connect()) {
+        return false;
+    }
+
+    std::vector<std::vector<std::pair<uint32_t, Couple>>> couples(memory.size());
+    bool loaded = mongo.ExportSongs([&](uint32_t songID, const Song& song) {
+        memory[0]->LoadSong(songID, song);
+    }) && mongo.ExportFingerprints([&](uint32_t address, const Couple& couple) {
+        couples[ShardedClient::ShardOf(address, memory.size())].emplace_back(address, couple);
+    });
+    for (size_t i = 0; i < memory.size(); i++) {
+        memory[i]->BulkLoad(couples[i]);
+    }
+    return loaded;
+}
+
+static std::unique_ptr<DBClient> newMemoryClient(size_t shards) {
+    std::vector<std::unique_ptr<DBClient>> clients;
+    std::vector<MemoryClient*> memory;
+    for (size_t i = 0; i < shards; i++) {
+        auto client = std::make_unique<MemoryClient>();
+        memory.push_back(client.get());
+        clients.push_back(std::move(client));
+    }
+
+    if (!loadFromMongo(memory)) {
+        std::cerr << "Warning: could not load the in-memory index from MongoDB, starting empty" << std::endl;
+    }
+    if (shards == 1) {
+        return std::move(clients[0]);
+    }
+    return std::make_unique<ShardedClient>(std::move(clients));
+}
+
+// DB_BACKEND selects the implementation: "mongo" (default), "memory", an
+// in-process index bulk-loaded from the Mongo collections at startup, or
+// "mmap", a read-only index file at DB_INDEX_PATH written by export-index.
+// The fingerprint table can be sharded by address range: over several Mongo
+// deployments listed in DB_SHARD_URIS (comma-separated, songs live on the
+// first), or over DB_SHARDS in-memory indexes.
 std::unique_ptr<DBClient> NewDBClient() {
-    return std::make_unique<MongoClient>("mongodb://localhost:27017");
+    std::string backend = getEnv("DB_BACKEND", "mongo");
+
+    if (backend == "mmap") {
+        return std::make_unique<IndexFileClient>(getEnv("DB_INDEX_PATH", "fingerprints.idx"),
+                                                 getEnv("DB_INDEX_VERIFY", "0") == "1");
+    }
+
+    if (backend == "memory") {
+        return newMemoryClient(static_cast<size_t>(std::max(1, std::atoi(getEnv("DB_SHARDS", "1").c_str()))));
+    }
+
+    std::string shardUris = getEnv("DB_SHARD_URIS", "");
+    if (!shardUris.empty()) {
+        std::vector<std::unique_ptr<DBClient>> shards;
+        std::istringstream uris(shardUris);
+        std::string uri;
+        while (std::getline(uris, uri, ',')) {
+            if (!uri.empty()) shards.push_back(std::make_unique<MongoClient>(uri));
+        }
+        return std::make_unique<ShardedClient>(std::move(shards));
+    }
+
+    return std::make_unique<MongoClient>();
 }
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <chrono>
+#include <header/mongo.h>
+#include <header/indexfile.h>
+
+
+// Exports the songs and fingerprints collections into an index file that
+// shazam can map with DB_BACKEND=mmap
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: ./export-index <index_file_path>" << std::endl;
+        return 1;
+    }
+
+    std::string indexPath = argv[1];
+    auto start = std::chrono::high_resolution_clock::now();
+
+    MongoClient db;
+    if (!db.Connect()) {
+        std::cerr << "Database connection failed." << std::endl;
+        return 1;
+    }
+
+    IndexFileWriter writer;
+    bool exported = db.ExportSongs([&](uint32_t songID, const Song& song) {
+        writer.AddSong(songID, song);
+    }) && db.ExportFingerprints([&](uint32_t address, const Couple& couple) {
+        writer.AddCouple(address, couple);
+    });
+    if (!exported || !writer.Write(indexPath)) {
+        std::cerr << "Failed to export index." << std::endl;
+        return 1;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "Exported " << writer.Songs() << " songs and " << writer.Couples()
+              << " couples to " << indexPath << " in " << elapsed.count() << " seconds" << std::endl;
+    return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <header/utils.h>
+#include <header/decoder.h>
+#include <header/mp3.h>
+#include <header/audiofile.h>
+#include <header/libav.h>
+
+
+// Picks a backend from the file extension: mpg123 for MP3, libsndfile for the
+// formats it reads natively and libav for everything else
+inline std::unique_ptr<AudioDecoder> NewAudioDecoder(const std::string& filePath) {
+    std::string extension = fs::path(filePath).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == ".mp3") {
+        return std::make_unique<MP3Decoder>();
+    }
+    if (extension == ".wav" || extension == ".flac" || extension == ".aiff" ||
+        extension == ".aif" || extension == ".ogg") {
+        return std::make_unique<SndfileDecoder>();
+    }
+    return std::make_unique<LibavDecoder>();
+}
+
+
+// Opens the file with the preferred backend, falling back to libav when that
+// backend rejects it (e.g. a WAV holding a codec libsndfile does not know)
+inline std::unique_ptr<AudioDecoder> OpenAudioDecoder(const std::string& filePath) {
+    std::unique_ptr<AudioDecoder> decoder = NewAudioDecoder(filePath);
+    if (decoder->Open(filePath)) {
+        return decoder;
+    }
+    if (dynamic_cast<LibavDecoder*>(decoder.get())) {
+        return nullptr;
+    }
+
+    decoder = std::make_unique<LibavDecoder>();
+    if (decoder->Open(filePath)) {
+        return decoder;
+    }
+    return nullptr;
+}
+
+
+// Decodes a whole file of any supported format to mono samples
+inline std::tuple<std::vector<double>, long, int, double> decodeAudioFile(const std::string& filePath) {
+    std::vector<double> samples;
+    std::unique_ptr<AudioDecoder> decoder = OpenAudioDecoder(filePath);
+    if (!decoder || !decoder->DecodeAll(samples)) {
+        return {std::vector<double>(), 0, 1, 0.0};
+    }
+
+    long sampleRate = decoder->SampleRate();
+    double duration = sampleRate > 0 ? static_cast<double>(samples.size()) / sampleRate : 0.0;
+    return {std::move(samples), sampleRate, 1, duration};
+}
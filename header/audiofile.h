@@ -0,0 +1,82 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sndfile.h>
+#include <header/decoder.h>
+
+
+// WAV/FLAC/AIFF/OGG through libsndfile, at the file's native sample rate
+class SndfileDecoder : public AudioDecoder {
+public:
+    ~SndfileDecoder() override {
+        Close();
+    }
+
+    bool Open(const std::string& filePath) override {
+        Close();
+        info = SF_INFO{};
+        file = sf_open(filePath.c_str(), SFM_READ, &info);
+        if (!file) {
+            std::cerr << "Error opening audio file: " << filePath << " (" << sf_strerror(NULL) << ")" << std::endl;
+            return false;
+        }
+        if (info.channels <= 0 || info.samplerate <= 0) {
+            std::cerr << "Unsupported audio format: " << filePath << std::endl;
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() override {
+        if (file) {
+            sf_close(file);
+            file = nullptr;
+        }
+    }
+
+    long SampleRate() const override { return file ? info.samplerate : 0; }
+    long EstimatedLength() const override { return file ? static_cast<long>(info.frames) : 0; }
+
+    bool Decode(const BlockCallback& onBlock) override {
+        if (!file) return false;
+
+        const int channels = info.channels;
+        interleaved.resize(BLOCK_FRAMES * channels);
+        mono.resize(BLOCK_FRAMES);
+
+        sf_count_t frames;
+        while ((frames = sf_readf_double(file, interleaved.data(), BLOCK_FRAMES)) > 0) {
+            if (channels == 1) {
+                if (!onBlock(interleaved.data(), static_cast<size_t>(frames))) return true;
+                continue;
+            }
+
+            // Downmix by averaging the channels
+            const double scale = 1.0 / channels;
+            for (sf_count_t i = 0; i < frames; i++) {
+                double sum = 0.0;
+                for (int c = 0; c < channels; c++) {
+                    sum += interleaved[i * channels + c];
+                }
+                mono[i] = sum * scale;
+            }
+            if (!onBlock(mono.data(), static_cast<size_t>(frames))) return true;
+        }
+
+        if (sf_error(file) != SF_ERR_NO_ERROR) {
+            std::cerr << "Error decoding audio file: " << sf_strerror(file) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static const sf_count_t BLOCK_FRAMES = 4096;
+
+    SNDFILE* file = nullptr;
+    SF_INFO info{};
+    std::vector<double> interleaved;
+    std::vector<double> mono;
+};
@@ -7,8 +7,10 @@
 #include <map>
 #include <optional>
 #include <memory>
+#include <functional>
 #include <cstdint>
 #include <header/models.h>
+#include <header/fingerprintconfig.h>
 
 
 struct Song {
@@ -17,6 +19,28 @@ struct Song {
 };
 
 
+// Collection holding the addresses of a hash version and preset in the
+// documents or packed schema, so indexes of different versions and presets
+// can sit side by side. Version 1 and the balanced preset keep the names they
+// had before the others existed.
+inline std::string FingerprintCollectionName(bool packed, FingerprintPreset preset = ActiveFingerprintPreset(),
+                                             int hashVersion = FINGERPRINT_HASH_VERSION) {
+    std::string name = "fingerprints";
+    if (hashVersion > 1) name += "_v" + std::to_string(hashVersion);
+    if (preset != FingerprintPreset::Balanced) name += std::string("_") + FingerprintPresetName(preset);
+    return packed ? name + "_packed" : name;
+}
+
+
+// Addresses keep the anchor bin in their top bits, and a preset may leave the
+// top bits zero, so the raw value is a poor key for splitting the address
+// space. Shards and lookup directories split on this mix instead. Multiplying
+// by an odd constant is a bijection, so distinct addresses keep distinct keys.
+inline uint32_t MixAddress(uint32_t address) {
+    return address * 0x9E3779B1u;
+}
+
+
 class DBClient {
 public:
     virtual ~DBClient() = default;
@@ -25,8 +49,8 @@ public:
     virtual void Disconnect() = 0;
     virtual bool IsConnected() const = 0;
     
-    virtual bool StoreFingerprints(const std::unordered_map<uint32_t, Couple>& fingerprints) = 0;
-    virtual std::map<uint32_t, std::vector<Couple>> GetCouples(const std::vector<uint32_t>& addresses) = 0;
+    virtual bool StoreFingerprints(uint32_t songID, const std::vector<FingerprintHash>& fingerprints) = 0;
+    virtual CoupleTable GetCouples(const std::vector<uint32_t>& addresses) = 0;
     
     virtual int TotalSongs() = 0;
     virtual uint32_t RegisterSong(const std::string& songTitle, const std::string& songArtist) = 0;
@@ -34,9 +58,19 @@ public:
     virtual std::optional<Song> GetSong(const std::string& filterKey, const std::string& value) = 0;
     virtual std::optional<Song> GetSongByID(uint32_t songID) = 0;
     virtual std::optional<Song> GetSongByKey(const std::string& key) = 0;
+    // One lookup for several songs; result[i] belongs to songIDs[i]
+    virtual std::vector<std::optional<Song>> GetSongsByIDs(const std::vector<uint32_t>& songIDs) = 0;
+    // Streams every song, e.g. to fill a SongCache or another backend
+    virtual bool ExportSongs(const std::function<void(uint32_t songID, const Song& song)>& onSong) = 0;
     
     virtual bool DeleteSongByID(uint32_t songID) = 0;
+    // Removes the couples of songID stored under `addresses` (repeats are
+    // fine), e.g. when an ingest fails after some batches were stored
+    virtual bool DeleteFingerprints(uint32_t songID, const std::vector<uint32_t>& addresses) = 0;
     virtual bool DeleteCollection(const std::string& collectionName) = 0;
+
+    // Backend counters, e.g. connection pool wait times; empty if none
+    virtual std::map<std::string, double> Metrics() { return {}; }
 };
 
 
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+
+// Common interface of the audio decoders. Every backend produces mono double
+// samples in blocks, at the rate reported by SampleRate() after Open(). That
+// is the file's own rate: the fingerprint pipeline resamples to the analysis
+// rate of its preset in one pass, so decoders do not resample on their own.
+class AudioDecoder {
+public:
+    // Return false from the callback to stop decoding early
+    using BlockCallback = std::function<bool(const double* samples, size_t count)>;
+
+    virtual ~AudioDecoder() = default;
+
+    virtual bool Open(const std::string& filePath) = 0;
+    virtual void Close() = 0;
+    virtual long SampleRate() const = 0;
+    // Length in samples from the container headers; <= 0 if unknown
+    virtual long EstimatedLength() const = 0;
+    virtual bool Decode(const BlockCallback& onBlock) = 0;
+
+    bool DecodeAll(std::vector<double>& samples) {
+        long length = EstimatedLength();
+        if (length > 0) {
+            // Some slack for estimates that come out short
+            samples.reserve(samples.size() + length + length / 16);
+        }
+        return Decode([&](const double* block, size_t count) {
+            samples.insert(samples.end(), block, block + count);
+            return true;
+        });
+    }
+};
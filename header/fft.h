@@ -1,50 +1,157 @@
+#pragma once
 #include <iostream>
 #include <vector>
 #include <complex>
 #include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <header/simd.h>
 
 using namespace std;
 using Complex = complex<double>;
 
 
-vector<Complex> recursiveFFT(vector<Complex>& input) {
-    int N = input.size();
-    if (N <= 1) return input;
-    
-    vector<Complex> even(N / 2), odd(N / 2);
-    for (int i = 0; i < N / 2; i++) {
-        even[i] = input[i * 2];
-        odd[i] = input[i * 2 + 1];
+// Iterative radix-2 FFT with precomputed bit-reversal and twiddle tables.
+// A plan is immutable after construction, so one instance can be shared by
+// any number of threads as long as each one transforms its own buffer.
+// Butterflies run through the SIMD kernels selected for the current CPU.
+template <typename T>
+class BasicFFTPlan {
+private:
+    size_t n;
+    vector<uint32_t> bitReverse;
+    // Twiddles of the stage with half-size h live at [h - 1, 2h - 1)
+    vector<complex<T>> twiddles;
+    const SimdKernels<T>& kernels;
+
+public:
+    explicit BasicFFTPlan(size_t size) : n(size), kernels(GetSimdKernels<T>()) {
+        if (n == 0 || (n & (n - 1)) != 0) {
+            throw invalid_argument("FFT size must be a power of two");
+        }
+
+        int bits = 0;
+        while ((size_t(1) << bits) < n) bits++;
+
+        bitReverse.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            uint32_t r = 0;
+            for (int b = 0; b < bits; b++) {
+                if (i & (size_t(1) << b)) r |= uint32_t(1) << (bits - 1 - b);
+            }
+            bitReverse[i] = r;
+        }
+
+        twiddles.resize(n > 1 ? n - 1 : 0);
+        for (size_t h = 1; h < n; h <<= 1) {
+            for (size_t j = 0; j < h; j++) {
+                Complex w = polar(1.0, -M_PI * j / h);
+                twiddles[h - 1 + j] = complex<T>(T(w.real()), T(w.imag()));
+            }
+        }
     }
-    
-    even = recursiveFFT(even);
-    odd = recursiveFFT(odd);
-    
-    vector<Complex> fftResult(N);
-    for (int k = 0; k < N / 2; k++) {
-        Complex t = polar(1.0, -2 * M_PI * k / N) * odd[k];
-        fftResult[k] = even[k] + t;
-        fftResult[k + N / 2] = even[k] - t;
+
+    size_t Size() const { return n; }
+
+    // In-place forward transform of n complex values
+    void Transform(complex<T>* data) const {
+        for (size_t i = 0; i < n; i++) {
+            size_t j = bitReverse[i];
+            if (i < j) swap(data[i], data[j]);
+        }
+
+        for (size_t h = 1; h < n; h <<= 1) {
+            kernels.butterfly(data, &twiddles[h - 1], n, h);
+        }
     }
-    
-    return fftResult;
-}
+};
+
+
+// Forward FFT of n real samples producing only the n/2 + 1 non-redundant bins.
+// The input is packed into an n/2-point complex transform and unpacked with one
+// extra twiddle pass, so it costs roughly half of a full complex FFT.
+template <typename T>
+class BasicRealFFTPlan {
+private:
+    size_t n;
+    BasicFFTPlan<T> half;
+    vector<complex<T>> twiddles;
+
+public:
+    explicit BasicRealFFTPlan(size_t size) : n(size), half(size >= 2 ? size / 2 : 1) {
+        if (n < 2 || (n & (n - 1)) != 0) {
+            throw invalid_argument("Real FFT size must be a power of two >= 2");
+        }
+        twiddles.resize(n / 2 + 1);
+        for (size_t k = 0; k <= n / 2; k++) {
+            Complex w = polar(1.0, -2 * M_PI * k / n);
+            twiddles[k] = complex<T>(T(w.real()), T(w.imag()));
+        }
+    }
+
+    size_t Size() const { return n; }
+    size_t Bins() const { return n / 2 + 1; }
+
+    // `output` must hold Bins() values and is also used as the working buffer
+    void Transform(const T* input, complex<T>* output) const {
+        const size_t m = n / 2;
+        for (size_t i = 0; i < m; i++) {
+            output[i] = complex<T>(input[2 * i], input[2 * i + 1]);
+        }
+        half.Transform(output);
+
+        complex<T> z0 = output[0];
+        output[0] = complex<T>(z0.real() + z0.imag(), T(0));
+        output[m] = complex<T>(z0.real() - z0.imag(), T(0));
+
+        // Bins k and m - k are unpacked from the same pair of half-size outputs
+        for (size_t k = 1; k <= m / 2; k++) {
+            complex<T> a = output[k];
+            complex<T> b = conj(output[m - k]);
+            complex<T> even = T(0.5) * (a + b);
+            complex<T> odd = complex<T>(T(0), T(-0.5)) * (a - b);
+            complex<T> t = twiddles[k] * odd;
+            output[k] = even + t;
+            output[m - k] = conj(even - t);
+        }
+    }
+};
 
+using FFTPlan = BasicFFTPlan<double>;
+using RealFFTPlan = BasicRealFFTPlan<double>;
+// Single-precision variants; enough when only the argmax bin per band matters
+using FFTPlanF = BasicFFTPlan<float>;
+using RealFFTPlanF = BasicRealFFTPlan<float>;
 
-vector<Complex> FFT(const vector<double>& input) {
-    vector<Complex> complexInput(input.begin(), input.end());
-    return recursiveFFT(complexInput);
+
+// Plans are built once per size and kept for the lifetime of the process
+template <typename T = double>
+inline const BasicRealFFTPlan<T>& GetRealFFTPlan(size_t size) {
+    static mutex cacheMutex;
+    static map<size_t, unique_ptr<BasicRealFFTPlan<T>>> cache;
+
+    lock_guard<mutex> lock(cacheMutex);
+    auto& plan = cache[size];
+    if (!plan) plan = make_unique<BasicRealFFTPlan<T>>(size);
+    return *plan;
 }
 
-// // Main function to test FFT
-// int main() {
-//     vector<double> signal = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0}; // Example input
-//     vector<Complex> fftResult = FFT(signal);
 
-//     cout << "FFT Output:\n";
-//     for (const auto& c : fftResult) {
-//         cout << c << endl;
-//     }
+// Full N-point spectrum of a real signal; the upper half is mirrored from the
+// conjugate-symmetric lower half computed by the real transform.
+inline vector<Complex> FFT(const vector<double>& input) {
+    if (input.size() <= 1) {
+        return vector<Complex>(input.begin(), input.end());
+    }
 
-//     return 0;
-// }
\ No newline at end of file
+    const RealFFTPlan& plan = GetRealFFTPlan(input.size());
+    vector<Complex> fftResult(input.size());
+    plan.Transform(input.data(), fftResult.data());
+    for (size_t k = plan.Bins(); k < input.size(); k++) {
+        fftResult[k] = conj(fftResult[input.size() - k]);
+    }
+    return fftResult;
+}
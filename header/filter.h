@@ -1,44 +1,180 @@
-#include <iostream>
+#pragma once
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <header/simd.h>
 
-using namespace std;
+// Zero crossings of the sinc kernel on each side of its centre, and the Kaiser
+// window shape. More crossings give a sharper transition band at the cost of
+// taps per output sample.
+#define RESAMPLER_ZERO_CROSSINGS 16
+#define RESAMPLER_KAISER_BETA 7.0
+// Most polyphase branches kept for one ratio; past it the branches are
+// interpolated (see below)
+#define RESAMPLER_MAX_PHASES 512
 
-class LowPassFilter {
-private:
-    double alpha; 
-    double yPrev;
+
+// Anti-aliasing filter and sample rate converter in one pass. The input is
+// conceptually upsampled by L, low-pass filtered with a Kaiser-windowed sinc and
+// decimated by M (L/M = outputRate/inputRate, reduced). Only the kept outputs
+// are computed: each one is a single dot product of the input history with one
+// of the L polyphase branches, so any rational ratio works, e.g. 44100 -> 11025
+// (1/4) and 48000 -> 11025 (147/640).
+//
+// A rate with a large reduced L, e.g. 44101 -> 11025 (L = 11025), would need L
+// branches and an L-times longer prototype. Past RESAMPLER_MAX_PHASES the
+// prototype is designed at that fixed oversampling instead, and each output
+// blends the two branches either side of its exact phase linearly. Common
+// rates stay below the cap and keep the exact branches.
+//
+// Output n is centred on input time n * M / L, so the filter adds no delay.
+// Input can be pushed in blocks of any size; Flush() emits the outputs that
+// still wait for samples past the end of the input, and Reset() starts over.
+class PolyphaseResampler {
 public:
+    PolyphaseResampler(int inputRate, int outputRate, double cutoffFrequency)
+        : simd(GetSimdKernels<double>()) {
+        if (inputRate <= 0 || outputRate <= 0) {
+            throw std::invalid_argument("Sample rates must be positive");
+        }
+        int64_t g = std::gcd(inputRate, outputRate);
+        up = outputRate / g;
+        down = inputRate / g;
+
+        // Prototype low-pass at the upsampled rate. An interpolated one spans
+        // whole input samples, so the delay is still exact in steps of 1/L.
+        interpolate = up > RESAMPLER_MAX_PHASES;
+        int64_t oversampling = interpolate ? RESAMPLER_MAX_PHASES : up;
+        double upRate = static_cast<double>(inputRate) * oversampling;
+        double cutoff = std::min(cutoffFrequency, 0.5 * std::min(inputRate, outputRate)) / upRate;
+        int64_t half = static_cast<int64_t>(std::ceil(RESAMPLER_ZERO_CROSSINGS / (2.0 * cutoff)));
+        if (interpolate) {
+            half = (half + oversampling - 1) / oversampling * oversampling;
+        }
+        std::vector<double> prototype(2 * half + 1);
+        double sum = 0.0;
+        for (int64_t k = -half; k <= half; k++) {
+            double x = 2.0 * cutoff * k;
+            double sinc = k == 0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+            double r = static_cast<double>(k) / half;
+            double window = besselI0(RESAMPLER_KAISER_BETA * std::sqrt(1.0 - r * r)) / besselI0(RESAMPLER_KAISER_BETA);
+            prototype[k + half] = sinc * window;
+            sum += prototype[k + half];
+        }
+        delay = interpolate ? half / oversampling * up : half;
+
+        // Branch p holds prototype[p + j * oversampling] reversed, so it lines
+        // up with the input history in increasing time order. The gain makes
+        // up for the zeros of the upsampling. Interpolation also reads branch
+        // `oversampling`, the first one a sample later.
+        size_t branches = static_cast<size_t>(oversampling) + (interpolate ? 1 : 0);
+        taps = static_cast<size_t>((prototype.size() + oversampling - 1) / oversampling);
+        phases.assign(branches * taps, 0.0);
+        for (size_t p = 0; p < branches; p++) {
+            for (size_t j = 0; j < taps; j++) {
+                size_t k = p + j * static_cast<size_t>(oversampling);
+                if (k < prototype.size()) {
+                    phases[p * taps + (taps - 1 - j)] = prototype[k] * oversampling / sum;
+                }
+            }
+        }
+
+        Reset();
+    }
+
+    // Starts a new signal; the filter and the history capacity are kept
+    void Reset() {
+        // Samples before the start of the input read as silence
+        history.assign(taps - 1, 0.0);
+        historyStart = -static_cast<int64_t>(taps - 1);
+        received = 0;
+        produced = 0;
+    }
+
+    int64_t Up() const { return up; }
+    int64_t Down() const { return down; }
+    size_t Taps() const { return taps; }
+
+    // Appends the outputs that the new samples complete
+    void Process(const double* input, size_t count, std::vector<double>& output) {
+        history.insert(history.end(), input, input + count);
+        received += count;
+        produce(received, output);
+    }
+
+    void Process(const std::vector<double>& input, std::vector<double>& output) {
+        Process(input.data(), input.size(), output);
+    }
+
+    // Appends the remaining outputs, reading silence past the end of the input.
+    // The total is ceil(inputSamples * L / M).
+    void Flush(std::vector<double>& output) {
+        uint64_t total = (received * up + down - 1) / down;
+        history.insert(history.end(), taps, 0.0);
+        produce(received + taps, output, total);
+    }
 
-    LowPassFilter(double cutoffFrequency, double sampleRate) {
-        double rc = 1.0 / (2 * M_PI * cutoffFrequency);
-        double dt = 1.0 / sampleRate;
-        alpha = dt / (rc + dt);
-        yPrev = 0;
+    // Batch form: the whole signal, flushed
+    std::vector<double> Resample(const std::vector<double>& input) {
+        std::vector<double> output;
+        output.reserve(static_cast<size_t>(input.size() * up / down + 1));
+        Process(input, output);
+        Flush(output);
+        return output;
     }
 
+private:
+    const SimdKernels<double>& simd;
+    int64_t up = 1;
+    int64_t down = 1;
+    int64_t delay = 0;
+    bool interpolate = false;
+    size_t taps = 0;
+    std::vector<double> phases;
+
+    // Input samples [historyStart, historyStart + history.size())
+    std::vector<double> history;
+    int64_t historyStart = 0;
+    uint64_t received = 0;
+    uint64_t produced = 0;
+
+    void produce(uint64_t available, std::vector<double>& output, uint64_t limit = UINT64_MAX) {
+        while (produced < limit) {
+            uint64_t t = produced * down + delay;
+            int64_t last = static_cast<int64_t>(t / up);
+            if (last >= static_cast<int64_t>(available)) break;
 
-    vector<double> filter(const vector<double>& input) {
-        vector<double> filtered(input.size());
-        for (size_t i = 0; i < input.size(); i++) {
-            if (i == 0) {
-                filtered[i] = input[i] * alpha;
+            const double* x = history.data() + (last - static_cast<int64_t>(taps) + 1 - historyStart);
+            if (!interpolate) {
+                output.push_back(simd.dot(phases.data() + (t % up) * taps, x, taps));
             } else {
-                filtered[i] = alpha * input[i] + (1 - alpha) * yPrev;
+                double position = static_cast<double>(t % up) * RESAMPLER_MAX_PHASES / up;
+                size_t branch = static_cast<size_t>(position);
+                double before = simd.dot(phases.data() + branch * taps, x, taps);
+                double after = simd.dot(phases.data() + (branch + 1) * taps, x, taps);
+                output.push_back(before + (position - branch) * (after - before));
             }
-            yPrev = filtered[i];
+            produced++;
         }
-        return filtered;
-    }
-};
 
-// int main() {
-//     vector<double> signal = {1.0, 2.0, 3.0, 4.0}; // Example input
-//     double cutoffFrequency = 1.0; // Example cutoff frequency
-//     double sampleRate = 10.0; // Example sample rate
+        // Drop the samples no later output reads, in large steps
+        int64_t next = static_cast<int64_t>((produced * down + delay) / up);
+        size_t unused = static_cast<size_t>(std::max<int64_t>(0, next - static_cast<int64_t>(taps) + 1 - historyStart));
+        unused = std::min(unused, history.size());
+        if (unused > 0 && unused >= history.size() / 2) {
+            history.erase(history.begin(), history.begin() + unused);
+            historyStart += static_cast<int64_t>(unused);
+        }
+    }
 
-//     LowPassFilter lpf(cutoffFrequency, sampleRate);
-//     vector<double> filteredSignal = lpf.filter(signal);
-    
-//     return 0;
-// }
\ No newline at end of file
+    static double besselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 50 && term > 1e-12 * sum; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+};
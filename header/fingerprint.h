@@ -1,46 +1,52 @@
+#pragma once
 #include <iostream>
 #include <vector>
 #include <unordered_map>
 #include <cstdint>
 #include <cmath>
-#include <complex>
+#include <algorithm>
 #include <header/models.h>
+#include <header/spectogram.h>
 
 using namespace std;
-std::unordered_map<uint32_t, Couple> Fingerprint(const std::vector<Peak>& peaks, uint32_t songID);
-
-const int maxfreqBits = 9;
-const int maxDeltaBits = 14;
-const int targetZoneSize = 5;
-
-
 
 
+// Milliseconds from the start of the track to the frame of a peak
+template <typename Config = DefaultFingerprintConfig>
+inline uint32_t PeakTimeMs(const Peak& peak) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(peak.frame) * Config::HopSize * 1000 / Config::AnalysisRate);
+}
 
-uint32_t createAddress(const Peak& anchor, const Peak& target) {
-    int anchorFreq = static_cast<int>((anchor.freq.real()));
-    int targetFreq = static_cast<int>((target.freq.real()));
-    uint32_t deltaMs = static_cast<uint32_t>((target.time - anchor.time) * 1000);
 
+// Anchor bin | target bin | frames from anchor to target (saturated), with
+// the field widths of the config. Changing this layout needs a new
+// FINGERPRINT_HASH_VERSION.
+template <typename Config = DefaultFingerprintConfig>
+inline uint32_t createAddress(const Peak& anchor, const Peak& target) {
+    constexpr uint32_t maxDelta = (1u << Config::DeltaBits) - 1;
+    uint32_t deltaFrames = std::min<uint32_t>(target.frame - anchor.frame, maxDelta);
 
-    return (static_cast<uint32_t>(anchorFreq) << (maxDeltaBits + maxfreqBits)) |
-           (static_cast<uint32_t>(targetFreq) << maxDeltaBits) |
-           deltaMs;
+    return (static_cast<uint32_t>(anchor.bin) << (Config::DeltaBits + Config::FreqBits)) |
+           (static_cast<uint32_t>(target.bin) << Config::DeltaBits) |
+           deltaFrames;
 }
 
 
-std::unordered_map<uint32_t, Couple> Fingerprint(const std::vector<Peak>& peaks, uint32_t songID){
-    std::unordered_map<uint32_t, Couple> fingerprints;
+template <typename Config = DefaultFingerprintConfig>
+inline std::vector<FingerprintHash> Fingerprint(const std::vector<Peak>& peaks){
+    constexpr size_t targetZoneSize = Config::TargetZoneSize;
+    std::vector<FingerprintHash> fingerprints;
+    fingerprints.reserve(peaks.size() * targetZoneSize);
     
     for (size_t i = 0; i < peaks.size(); i++) {
         const Peak& anchor = peaks[i];
         
         for (size_t j = i + 1; j < peaks.size() && j <= i + targetZoneSize; j++) {
             const Peak& target = peaks[j];
-            uint32_t address = createAddress(anchor, target);
-            uint32_t anchorTimeMs = static_cast<uint32_t>(anchor.time * 1000);
+            uint32_t address = createAddress<Config>(anchor, target);
+            uint32_t anchorTimeMs = PeakTimeMs<Config>(anchor);
             
-            fingerprints[address] = {anchorTimeMs, songID};
+            fingerprints.push_back({address, anchorTimeMs});
         }
     }
     
@@ -0,0 +1,139 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+
+// Fingerprint parameters as a policy type. The spectrogram, peak picker and
+// address packing are templated on one of these, so band loops have constant
+// bounds and the address shifts fold into the code. Each preset below is
+// instantiated once; FINGERPRINT_PRESET picks one at runtime.
+//
+// Presets hash differently: a catalog only matches queries made with the
+// preset it was loaded with, so stores keep the presets apart (see
+// FingerprintCollectionName and the index file header).
+
+struct FrequencyBand {
+    int begin;
+    int end;
+};
+
+// The scheme shipped before presets existed; catalogs built then are balanced
+struct BalancedFingerprintConfig {
+    static constexpr uint32_t Id = 0;
+    static constexpr const char* Name = "balanced";
+    static constexpr int AnalysisRate = 11025;  // Every input is resampled to this rate
+    static constexpr int MaxFreq = 5000;
+    static constexpr int FrameSize = 1024;
+    static constexpr int HopSize = FrameSize / 32;
+    static constexpr int PeakBins = 512;  // Bins scanned by the peak picker
+    static constexpr std::array<FrequencyBand, 6> Bands = {{
+        {0, 10}, {10, 20}, {20, 40}, {40, 80}, {80, 160}, {160, PeakBins}}};
+    static constexpr int FreqBits = 9;
+    static constexpr int DeltaBits = 14;
+    static constexpr int TargetZoneSize = 5;
+};
+
+// About a third of the frames and fewer couples per peak: a lower analysis
+// rate, shorter windows with a longer hop, and a smaller target zone
+struct FastFingerprintConfig {
+    static constexpr uint32_t Id = 1;
+    static constexpr const char* Name = "fast";
+    static constexpr int AnalysisRate = 8000;
+    static constexpr int MaxFreq = 3500;
+    static constexpr int FrameSize = 512;
+    static constexpr int HopSize = FrameSize / 8;
+    static constexpr int PeakBins = 256;
+    static constexpr std::array<FrequencyBand, 6> Bands = {{
+        {0, 5}, {5, 10}, {10, 20}, {20, 40}, {40, 80}, {80, PeakBins}}};
+    static constexpr int FreqBits = 8;
+    static constexpr int DeltaBits = 14;  // 30 address bits in all
+    static constexpr int TargetZoneSize = 3;
+};
+
+// Twice the frequency resolution at the same hop, one more band and a wider
+// target zone; more couples per track and a larger index
+struct AccurateFingerprintConfig {
+    static constexpr uint32_t Id = 2;
+    static constexpr const char* Name = "accurate";
+    static constexpr int AnalysisRate = 11025;
+    static constexpr int MaxFreq = 5000;
+    static constexpr int FrameSize = 2048;
+    static constexpr int HopSize = FrameSize / 64;
+    static constexpr int PeakBins = 1024;
+    static constexpr std::array<FrequencyBand, 7> Bands = {{
+        {0, 20}, {20, 40}, {40, 80}, {80, 160}, {160, 320}, {320, 640}, {640, PeakBins}}};
+    static constexpr int FreqBits = 10;
+    static constexpr int DeltaBits = 12;
+    static constexpr int TargetZoneSize = 8;
+};
+
+using DefaultFingerprintConfig = BalancedFingerprintConfig;
+
+
+// Bands must tile [0, PeakBins) in order, every bin must fit its address
+// field, and two bins plus a frame delta must fit 32 bits. They need not fill
+// them: the fast preset leaves the top two address bits zero. Nothing may
+// split the address space on the raw top bits; shards and lookup directories
+// use MixAddress (client.h), which spreads any layout evenly.
+template <typename Config>
+constexpr bool IsValidFingerprintConfig() {
+    int next = 0;
+    for (const FrequencyBand& band : Config::Bands) {
+        if (band.begin != next || band.end <= band.begin) return false;
+        next = band.end;
+    }
+    return next == Config::PeakBins &&
+           Config::PeakBins <= Config::FrameSize / 2 + 1 &&
+           Config::PeakBins <= (1 << Config::FreqBits) &&
+           2 * Config::FreqBits + Config::DeltaBits <= 32 &&
+           Config::HopSize > 0 && Config::HopSize <= Config::FrameSize &&
+           2 * Config::MaxFreq <= Config::AnalysisRate;
+}
+
+static_assert(IsValidFingerprintConfig<BalancedFingerprintConfig>(), "invalid balanced fingerprint config");
+static_assert(IsValidFingerprintConfig<FastFingerprintConfig>(), "invalid fast fingerprint config");
+static_assert(IsValidFingerprintConfig<AccurateFingerprintConfig>(), "invalid accurate fingerprint config");
+
+
+enum class FingerprintPreset : uint32_t {
+    Balanced = BalancedFingerprintConfig::Id,
+    Fast = FastFingerprintConfig::Id,
+    Accurate = AccurateFingerprintConfig::Id,
+};
+
+// Calls fn with a value of the config type of the preset and returns its result
+template <typename F>
+inline decltype(auto) WithFingerprintConfig(FingerprintPreset preset, F&& fn) {
+    switch (preset) {
+    case FingerprintPreset::Fast:
+        return fn(FastFingerprintConfig{});
+    case FingerprintPreset::Accurate:
+        return fn(AccurateFingerprintConfig{});
+    case FingerprintPreset::Balanced:
+    default:
+        return fn(BalancedFingerprintConfig{});
+    }
+}
+
+inline const char* FingerprintPresetName(FingerprintPreset preset) {
+    return WithFingerprintConfig(preset, [](auto config) { return decltype(config)::Name; });
+}
+
+// FINGERPRINT_PRESET selects the preset used by ingest, queries and the
+// stores: "balanced" (default), "fast" or "accurate"
+inline FingerprintPreset ActiveFingerprintPreset() {
+    static const FingerprintPreset preset = []() {
+        const char* value = std::getenv("FINGERPRINT_PRESET");
+        if (!value || !*value) return FingerprintPreset::Balanced;
+        for (FingerprintPreset candidate : {FingerprintPreset::Balanced, FingerprintPreset::Fast,
+                                            FingerprintPreset::Accurate}) {
+            if (std::strcmp(value, FingerprintPresetName(candidate)) == 0) return candidate;
+        }
+        std::cerr << "Unknown FINGERPRINT_PRESET " << value << ", using balanced" << std::endl;
+        return FingerprintPreset::Balanced;
+    }();
+    return preset;
+}
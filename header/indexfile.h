@@ -0,0 +1,488 @@
+#ifndef INDEX_FILE_H
+#define INDEX_FILE_H
+
+#include <header/client.h>
+#include <header/utils.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Immutable fingerprint index file, used through mmap without parsing.
+//
+// Layout (little-endian, every section 8-byte aligned):
+//   IndexFileHeader
+//   directory  uint32[2^16 + 1]   first key index per top-16-bit bucket
+//   keys       uint32[addressCount], MixAddress of each address, sorted
+//   offsets    uint64[addressCount + 1], couples of keys[i] are
+//              postings[offsets[i], offsets[i + 1])
+//   postings   Couple[postingCount]
+//   songs      IndexFileSong[songCount], sorted by songID
+//   strings    char[stringBytes], titles and artists referenced by the songs
+//
+// The header records the FINGERPRINT_HASH_VERSION and the preset of the
+// addresses; a file of another version or preset is refused rather than
+// queried with mismatched hashes. Files written before presets existed hold 0,
+// the balanced preset, in that field.
+// The checksum is FNV-1a over everything after the header. Verifying it reads
+// the whole file, so it is only done on request (DB_INDEX_VERIFY=1).
+
+#define INDEX_FILE_MAGIC "SHZIDX01"
+#define INDEX_FILE_VERSION 3
+#define INDEX_DIRECTORY_BITS 16
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t directoryBits;
+    uint32_t hashVersion;
+    uint32_t preset;
+    uint64_t addressCount;
+    uint64_t postingCount;
+    uint64_t songCount;
+    uint64_t stringBytes;
+    uint64_t directoryOffset;
+    uint64_t addressesOffset;
+    uint64_t offsetsOffset;
+    uint64_t postingsOffset;
+    uint64_t songsOffset;
+    uint64_t stringsOffset;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+
+struct IndexFileSong {
+    uint32_t songID;
+    uint32_t titleLength;
+    uint64_t titleOffset;
+    uint32_t artistLength;
+    uint32_t reserved;
+    uint64_t artistOffset;
+};
+
+static_assert(sizeof(Couple) == 8, "Couple is stored as-is in the index file");
+
+
+inline uint64_t indexChecksum(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t alignIndexOffset(uint64_t offset) {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+
+// Collects couples and songs, then writes them out as one index file
+class IndexFileWriter {
+public:
+    void AddCouple(uint32_t address, const Couple& couple) {
+        couples.emplace_back(MixAddress(address), couple);
+    }
+
+    void AddSong(uint32_t songID, const Song& song) {
+        songs.emplace_back(songID, song);
+    }
+
+    size_t Couples() const { return couples.size(); }
+    size_t Songs() const { return songs.size(); }
+
+    // Writes to a temporary file and renames it over `path`, so readers never
+    // map a half-written index
+    bool Write(const std::string& path) {
+        std::stable_sort(couples.begin(), couples.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        std::sort(songs.begin(), songs.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        std::vector<uint32_t> keys;
+        std::vector<uint64_t> offsets{0};
+        std::vector<Couple> postings;
+        postings.reserve(couples.size());
+        for (const auto& [key, couple] : couples) {
+            if (keys.empty() || keys.back() != key) {
+                keys.push_back(key);
+                offsets.push_back(offsets.back());
+            }
+            postings.push_back(couple);
+            offsets.back()++;
+        }
+
+        std::vector<uint32_t> directory((size_t(1) << INDEX_DIRECTORY_BITS) + 1, 0);
+        for (uint32_t key : keys) {
+            directory[(key >> (32 - INDEX_DIRECTORY_BITS)) + 1]++;
+        }
+        for (size_t b = 1; b < directory.size(); b++) {
+            directory[b] += directory[b - 1];
+        }
+
+        std::vector<IndexFileSong> songTable;
+        std::string strings;
+        for (const auto& [songID, song] : songs) {
+            IndexFileSong entry{};
+            entry.songID = songID;
+            entry.titleOffset = strings.size();
+            entry.titleLength = static_cast<uint32_t>(song.title.size());
+            strings += song.title;
+            entry.artistOffset = strings.size();
+            entry.artistLength = static_cast<uint32_t>(song.artist.size());
+            strings += song.artist;
+            songTable.push_back(entry);
+        }
+
+        IndexFileHeader header{};
+        std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+        header.version = INDEX_FILE_VERSION;
+        header.directoryBits = INDEX_DIRECTORY_BITS;
+        header.hashVersion = FINGERPRINT_HASH_VERSION;
+        header.preset = static_cast<uint32_t>(ActiveFingerprintPreset());
+        header.addressCount = keys.size();
+        header.postingCount = postings.size();
+        header.songCount = songTable.size();
+        header.stringBytes = strings.size();
+        header.directoryOffset = alignIndexOffset(sizeof(IndexFileHeader));
+        header.addressesOffset = alignIndexOffset(header.directoryOffset + directory.size() * sizeof(uint32_t));
+        header.offsetsOffset = alignIndexOffset(header.addressesOffset + keys.size() * sizeof(uint32_t));
+        header.postingsOffset = alignIndexOffset(header.offsetsOffset + offsets.size() * sizeof(uint64_t));
+        header.songsOffset = alignIndexOffset(header.postingsOffset + postings.size() * sizeof(Couple));
+        header.stringsOffset = alignIndexOffset(header.songsOffset + songTable.size() * sizeof(IndexFileSong));
+        header.fileSize = header.stringsOffset + strings.size();
+
+        std::string tmpPath = path + ".tmp";
+        FILE* file = std::fopen(tmpPath.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Error creating index file: " << tmpPath << std::endl;
+            return false;
+        }
+
+        // The header goes last, once the checksum of the body is known
+        position = sizeof(IndexFileHeader);
+        checksum = indexChecksum(nullptr, 0);
+        std::fseek(file, static_cast<long>(position), SEEK_SET);
+        bool ok = writeSection(file, header.directoryOffset, directory.data(), directory.size() * sizeof(uint32_t)) &&
+                  writeSection(file, header.addressesOffset, keys.data(), keys.size() * sizeof(uint32_t)) &&
+                  writeSection(file, header.offsetsOffset, offsets.data(), offsets.size() * sizeof(uint64_t)) &&
+                  writeSection(file, header.postingsOffset, postings.data(), postings.size() * sizeof(Couple)) &&
+                  writeSection(file, header.songsOffset, songTable.data(), songTable.size() * sizeof(IndexFileSong)) &&
+                  writeSection(file, header.stringsOffset, strings.data(), strings.size());
+
+        header.checksum = checksum;
+        ok = ok && std::fseek(file, 0, SEEK_SET) == 0 &&
+             std::fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = (std::fclose(file) == 0) && ok;
+
+        if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::cerr << "Error writing index file: " << path << std::endl;
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::pair<uint32_t, Couple>> couples;
+    std::vector<std::pair<uint32_t, Song>> songs;
+    uint64_t position = 0;
+    uint64_t checksum = 0;
+
+    bool writeSection(FILE* file, uint64_t offset, const void* data, size_t size) {
+        static const char padding[8] = {};
+        size_t pad = static_cast<size_t>(offset - position);
+        if (pad > 0) {
+            if (std::fwrite(padding, 1, pad, file) != pad) return false;
+            checksum = indexChecksum(padding, pad, checksum);
+        }
+        if (size > 0 && std::fwrite(data, 1, size, file) != size) return false;
+        checksum = indexChecksum(static_cast<const char*>(data), size, checksum);
+        position = offset + size;
+        return true;
+    }
+};
+
+
+// Read-only DBClient over a mapped index file. Opening validates the header
+// and walks the directory, offsets and song table once, so a corrupt file
+// cannot send a lookup outside the mapping; the keys and postings are only
+// faulted in by the lookups that touch them.
+class IndexFileClient : public DBClient {
+public:
+    explicit IndexFileClient(const std::string& path, bool verify = false)
+        : path(path), verify(verify) {}
+
+    ~IndexFileClient() override {
+        Disconnect();
+    }
+
+    IndexFileClient(const IndexFileClient&) = delete;
+    IndexFileClient& operator=(const IndexFileClient&) = delete;
+
+    bool Connect() override {
+        if (data) return true;
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Error opening index file: " << path << std::endl;
+            return false;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(IndexFileHeader)) {
+            std::cerr << "Index file too small: " << path << std::endl;
+            ::close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(info.st_size);
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "Error mapping index file: " << path << std::endl;
+            return false;
+        }
+        data = static_cast<const char*>(mapped);
+        // Lookups jump around the file; don't read ahead whole regions
+        ::madvise(mapped, size, MADV_RANDOM);
+
+        if (!validate()) {
+            Disconnect();
+            return false;
+        }
+        return true;
+    }
+
+    void Disconnect() override {
+        if (data) {
+            ::munmap(const_cast<char*>(data), size);
+            data = nullptr;
+            size = 0;
+        }
+    }
+
+    bool IsConnected() const override {
+        return data != nullptr;
+    }
+
+    bool StoreFingerprints(uint32_t, const std::vector<FingerprintHash>&) override {
+        std::cerr << "Index file is read-only" << std::endl;
+        return false;
+    }
+
+    CoupleTable GetCouples(const std::vector<uint32_t>& queryAddresses) override {
+        CoupleTable result;
+        if (!data) return result;
+
+        for (uint32_t address : queryAddresses) {
+            uint32_t key = MixAddress(address);
+            uint32_t bucket = key >> (32 - INDEX_DIRECTORY_BITS);
+            const uint32_t* begin = keys + directory[bucket];
+            const uint32_t* end = keys + directory[bucket + 1];
+            const uint32_t* it = std::lower_bound(begin, end, key);
+            if (it == end || *it != key) continue;
+
+            size_t index = static_cast<size_t>(it - keys);
+            result.AddAddress(address);
+            for (uint64_t i = offsets[index]; i < offsets[index + 1]; i++) {
+                result.AddCouple(postings[i]);
+            }
+        }
+        return result;
+    }
+
+    int TotalSongs() override {
+        return data ? static_cast<int>(header->songCount) : 0;
+    }
+
+    uint32_t RegisterSong(const std::string&, const std::string&) override {
+        std::cerr << "Index file is read-only" << std::endl;
+        return 0;
+    }
+
+    std::optional<Song> GetSong(const std::string& filterKey, const std::string& value) override {
+        if (filterKey == "_id") {
+            try {
+                return GetSongByID(static_cast<uint32_t>(std::stoul(value)));
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid argument: " << value << " is not a valid integer." << std::endl;
+                return std::nullopt;
+            }
+        }
+        if (filterKey == "key") {
+            return GetSongByKey(value);
+        }
+        std::cerr << "Invalid filter key: " << filterKey << std::endl;
+        return std::nullopt;
+    }
+
+    std::optional<Song> GetSongByID(uint32_t songID) override {
+        if (!data) return std::nullopt;
+
+        const IndexFileSong* end = songs + header->songCount;
+        const IndexFileSong* it = std::lower_bound(songs, end, songID,
+            [](const IndexFileSong& song, uint32_t id) { return song.songID < id; });
+        if (it == end || it->songID != songID) return std::nullopt;
+        return toSong(*it);
+    }
+
+    // The file has no key index; keys are only needed when adding songs
+    std::optional<Song> GetSongByKey(const std::string& key) override {
+        if (!data) return std::nullopt;
+
+        for (uint64_t i = 0; i < header->songCount; i++) {
+            Song song = toSong(songs[i]);
+            if (GenerateSongKey(song.title, song.artist) == key) return song;
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::optional<Song>> GetSongsByIDs(const std::vector<uint32_t>& songIDs) override {
+        std::vector<std::optional<Song>> result(songIDs.size());
+        for (size_t i = 0; i < songIDs.size(); i++) {
+            result[i] = GetSongByID(songIDs[i]);
+        }
+        return result;
+    }
+
+    bool ExportSongs(const std::function<void(uint32_t songID, const Song& song)>& onSong) override {
+        if (!data) return false;
+        for (uint64_t i = 0; i < header->songCount; i++) {
+            onSong(songs[i].songID, toSong(songs[i]));
+        }
+        return true;
+    }
+
+    bool DeleteSongByID(uint32_t) override {
+        std::cerr << "Index file is read-only" << std::endl;
+        return false;
+    }
+
+    bool DeleteFingerprints(uint32_t, const std::vector<uint32_t>&) override {
+        std::cerr << "Index file is read-only" << std::endl;
+        return false;
+    }
+
+    bool DeleteCollection(const std::string&) override {
+        std::cerr << "Index file is read-only" << std::endl;
+        return false;
+    }
+
+private:
+    std::string path;
+    bool verify;
+
+    const char* data = nullptr;
+    size_t size = 0;
+    const IndexFileHeader* header = nullptr;
+    const uint32_t* directory = nullptr;
+    const uint32_t* keys = nullptr;
+    const uint64_t* offsets = nullptr;
+    const Couple* postings = nullptr;
+    const IndexFileSong* songs = nullptr;
+    const char* strings = nullptr;
+
+    bool validate() {
+        header = reinterpret_cast<const IndexFileHeader*>(data);
+        if (std::memcmp(header->magic, INDEX_FILE_MAGIC, sizeof(header->magic)) != 0) {
+            std::cerr << "Not a fingerprint index file: " << path << std::endl;
+            return false;
+        }
+        if (header->version != INDEX_FILE_VERSION || header->directoryBits != INDEX_DIRECTORY_BITS) {
+            std::cerr << "Unsupported index file version " << header->version << ": " << path << std::endl;
+            return false;
+        }
+        if (header->hashVersion != FINGERPRINT_HASH_VERSION) {
+            std::cerr << "Index file holds fingerprint hash version " << header->hashVersion << ", expected "
+                      << FINGERPRINT_HASH_VERSION << "; re-export it: " << path << std::endl;
+            return false;
+        }
+        if (header->preset != static_cast<uint32_t>(ActiveFingerprintPreset())) {
+            std::cerr << "Index file was built with fingerprint preset " << header->preset << ", FINGERPRINT_PRESET is "
+                      << FingerprintPresetName(ActiveFingerprintPreset()) << ": " << path << std::endl;
+            return false;
+        }
+        // Counts are checked against the room left in the file before any of
+        // them is multiplied, so a huge count cannot wrap around. The keys
+        // check bounds addressCount, which makes addressCount + 1 safe.
+        if (header->fileSize != size ||
+            !fits(header->directoryOffset, (size_t(1) << INDEX_DIRECTORY_BITS) + 1, sizeof(uint32_t)) ||
+            !fits(header->addressesOffset, header->addressCount, sizeof(uint32_t)) ||
+            !fits(header->offsetsOffset, header->addressCount + 1, sizeof(uint64_t)) ||
+            !fits(header->postingsOffset, header->postingCount, sizeof(Couple)) ||
+            !fits(header->songsOffset, header->songCount, sizeof(IndexFileSong)) ||
+            !fits(header->stringsOffset, header->stringBytes, 1)) {
+            std::cerr << "Truncated or corrupt index file: " << path << std::endl;
+            return false;
+        }
+        if (verify && indexChecksum(data + sizeof(IndexFileHeader), size - sizeof(IndexFileHeader)) != header->checksum) {
+            std::cerr << "Index file checksum mismatch: " << path << std::endl;
+            return false;
+        }
+
+        directory = reinterpret_cast<const uint32_t*>(data + header->directoryOffset);
+        keys = reinterpret_cast<const uint32_t*>(data + header->addressesOffset);
+        offsets = reinterpret_cast<const uint64_t*>(data + header->offsetsOffset);
+        postings = reinterpret_cast<const Couple*>(data + header->postingsOffset);
+        songs = reinterpret_cast<const IndexFileSong*>(data + header->songsOffset);
+        strings = data + header->stringsOffset;
+
+        if (!validTables()) {
+            std::cerr << "Corrupt index tables: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool fits(uint64_t offset, uint64_t count, uint64_t elementSize) const {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / elementSize;
+    }
+
+    // Lookups index keys through directory[] and postings through offsets[],
+    // and toSong reads the string table; each must stay inside its section
+    bool validTables() const {
+        const size_t buckets = size_t(1) << INDEX_DIRECTORY_BITS;
+        if (directory[0] != 0 || directory[buckets] != header->addressCount) return false;
+        for (size_t b = 0; b < buckets; b++) {
+            if (directory[b] > directory[b + 1]) return false;
+        }
+
+        if (offsets[0] != 0 || offsets[header->addressCount] != header->postingCount) return false;
+        for (uint64_t i = 0; i < header->addressCount; i++) {
+            if (offsets[i] > offsets[i + 1]) return false;
+        }
+
+        for (uint64_t i = 0; i < header->songCount; i++) {
+            if (!validString(songs[i].titleOffset, songs[i].titleLength) ||
+                !validString(songs[i].artistOffset, songs[i].artistLength)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool validString(uint64_t offset, uint64_t length) const {
+        return offset <= header->stringBytes && length <= header->stringBytes - offset;
+    }
+
+    // Clamped as well as validated, so a song entry can never read past the
+    // string table
+    std::string stringAt(uint64_t offset, uint64_t length) const {
+        offset = std::min<uint64_t>(offset, header->stringBytes);
+        length = std::min<uint64_t>(length, header->stringBytes - offset);
+        return std::string(strings + offset, length);
+    }
+
+    Song toSong(const IndexFileSong& entry) const {
+        return Song{stringAt(entry.titleOffset, entry.titleLength),
+                    stringAt(entry.artistOffset, entry.artistLength)};
+    }
+};
+
+#endif
@@ -0,0 +1,194 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <header/decoder.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+}
+
+// FFmpeg 5.1 replaced the channel_layout bitmask with AVChannelLayout
+#define LIBAV_HAS_CH_LAYOUT (LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100))
+
+
+// Any format libavformat can demux, decoded and downmixed by swresample to mono
+// float. The output keeps the stream's rate unless outputRate is given.
+class LibavDecoder : public AudioDecoder {
+public:
+    explicit LibavDecoder(int outputRate = 0) : requestedRate(outputRate) {}
+
+    ~LibavDecoder() override {
+        Close();
+    }
+
+    LibavDecoder(const LibavDecoder&) = delete;
+    LibavDecoder& operator=(const LibavDecoder&) = delete;
+
+    bool Open(const std::string& filePath) override {
+        Close();
+        if (avformat_open_input(&format, filePath.c_str(), nullptr, nullptr) < 0) {
+            std::cerr << "Error opening audio file: " << filePath << std::endl;
+            return false;
+        }
+        if (avformat_find_stream_info(format, nullptr) < 0) {
+            return fail("Could not read stream info: " + filePath);
+        }
+
+        streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        if (streamIndex < 0) {
+            return fail("No audio stream in: " + filePath);
+        }
+
+        AVStream* stream = format->streams[streamIndex];
+        const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+        if (!codec) {
+            return fail("Unsupported codec in: " + filePath);
+        }
+        codecCtx = avcodec_alloc_context3(codec);
+        if (!codecCtx ||
+            avcodec_parameters_to_context(codecCtx, stream->codecpar) < 0 ||
+            avcodec_open2(codecCtx, codec, nullptr) < 0) {
+            return fail("Could not open decoder for: " + filePath);
+        }
+
+        outputRate = requestedRate > 0 ? requestedRate : codecCtx->sample_rate;
+        if (outputRate <= 0) {
+            return fail("Unknown sample rate in: " + filePath);
+        }
+
+#if LIBAV_HAS_CH_LAYOUT
+        AVChannelLayout inLayout;
+        if (codecCtx->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+            av_channel_layout_default(&inLayout, codecCtx->ch_layout.nb_channels);
+        } else {
+            av_channel_layout_copy(&inLayout, &codecCtx->ch_layout);
+        }
+        AVChannelLayout outLayout = AV_CHANNEL_LAYOUT_MONO;
+        int ret = swr_alloc_set_opts2(&swr, &outLayout, AV_SAMPLE_FMT_FLT, outputRate,
+                                      &inLayout, codecCtx->sample_fmt, codecCtx->sample_rate, 0, nullptr);
+        av_channel_layout_uninit(&inLayout);
+        if (ret < 0) swr_free(&swr);
+#else
+        int64_t inLayout = codecCtx->channel_layout
+            ? static_cast<int64_t>(codecCtx->channel_layout)
+            : av_get_default_channel_layout(codecCtx->channels);
+        swr = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_FLT, outputRate,
+                                 inLayout, codecCtx->sample_fmt, codecCtx->sample_rate, 0, nullptr);
+#endif
+        if (!swr || swr_init(swr) < 0) {
+            return fail("Could not set up resampler for: " + filePath);
+        }
+
+        packet = av_packet_alloc();
+        frame = av_frame_alloc();
+        if (!packet || !frame) {
+            return fail("Out of memory opening: " + filePath);
+        }
+        return true;
+    }
+
+    void Close() override {
+        av_frame_free(&frame);
+        av_packet_free(&packet);
+        swr_free(&swr);
+        avcodec_free_context(&codecCtx);
+        avformat_close_input(&format);
+        streamIndex = -1;
+    }
+
+    long SampleRate() const override { return codecCtx ? outputRate : 0; }
+
+    long EstimatedLength() const override {
+        if (!format || format->duration == AV_NOPTS_VALUE) return 0;
+        return static_cast<long>(format->duration * outputRate / AV_TIME_BASE);
+    }
+
+    bool Decode(const BlockCallback& onBlock) override {
+        if (!frame) return false;
+
+        bool keepGoing = true;
+        while (keepGoing) {
+            int ret = av_read_frame(format, packet);
+            if (ret == AVERROR_EOF) break;
+            if (ret < 0) {
+                std::cerr << "Error reading audio packet" << std::endl;
+                return false;
+            }
+
+            if (packet->stream_index == streamIndex) {
+                ret = avcodec_send_packet(codecCtx, packet);
+                // A corrupt packet costs a few milliseconds of audio, not the file
+                if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_INVALIDDATA) {
+                    av_packet_unref(packet);
+                    std::cerr << "Error decoding audio packet" << std::endl;
+                    return false;
+                }
+            }
+            av_packet_unref(packet);
+
+            if (!receiveFrames(onBlock, keepGoing)) return false;
+        }
+
+        if (keepGoing) {
+            // Drain the decoder, then whatever the resampler still buffers
+            avcodec_send_packet(codecCtx, nullptr);
+            if (!receiveFrames(onBlock, keepGoing)) return false;
+            if (keepGoing) emit(onBlock, nullptr, 0);
+        }
+        return true;
+    }
+
+private:
+    int requestedRate;  // 0 keeps the stream's rate
+    int outputRate = 0;
+    AVFormatContext* format = nullptr;
+    AVCodecContext* codecCtx = nullptr;
+    SwrContext* swr = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* frame = nullptr;
+    int streamIndex = -1;
+    std::vector<float> resampled;
+    std::vector<double> mono;
+
+    bool fail(const std::string& message) {
+        std::cerr << message << std::endl;
+        Close();
+        return false;
+    }
+
+    bool receiveFrames(const BlockCallback& onBlock, bool& keepGoing) {
+        while (keepGoing) {
+            int ret = avcodec_receive_frame(codecCtx, frame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return true;
+            if (ret < 0) {
+                std::cerr << "Error receiving decoded audio" << std::endl;
+                return false;
+            }
+            keepGoing = emit(onBlock, const_cast<const uint8_t**>(frame->extended_data), frame->nb_samples);
+            av_frame_unref(frame);
+        }
+        return true;
+    }
+
+    // Resamples one decoded frame (or flushes with input == nullptr)
+    bool emit(const BlockCallback& onBlock, const uint8_t** input, int inputSamples) {
+        int capacity = swr_get_out_samples(swr, inputSamples);
+        if (capacity <= 0) return true;
+
+        resampled.resize(capacity);
+        uint8_t* output = reinterpret_cast<uint8_t*>(resampled.data());
+        int converted = swr_convert(swr, &output, capacity, input, inputSamples);
+        if (converted <= 0) return true;
+
+        mono.resize(converted);
+        for (int i = 0; i < converted; i++) {
+            mono[i] = resampled[i];
+        }
+        return onBlock(mono.data(), static_cast<size_t>(converted));
+    }
+};
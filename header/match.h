@@ -0,0 +1,230 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <queue>
+#include <functional>
+#include <header/client.h>
+#include <header/utils.h>
+#include <header/pipeline.h>
+#include <header/songcache.h>
+
+
+struct Match {
+    uint32_t songID;
+    std::string songTitle;
+    std::string songArtist;
+    uint32_t timestamp;
+    double score;
+
+    Match(uint32_t id, const std::string& title, const std::string& artist,
+          uint32_t time, double sc)
+        : songID(id), songTitle(title), songArtist(artist),
+          timestamp(time), score(sc) {}
+};
+
+
+// Width of the offset histogram bins. True matches share one offset up to
+// the frame quantization (a few ms); random hits spread over the whole song.
+#define OFFSET_BIN_MS 50
+
+struct OffsetScore {
+    double score;
+    int64_t offsetMs;
+};
+
+
+// Candidates kept after counting raw hits, and the hits a song needs to be one
+#define MATCH_CANDIDATES 32
+#define MIN_CANDIDATE_HITS 2
+#define MAX_MATCH_RESULTS 10
+
+
+// Scores a song by the peak of its (dbTime - sampleTime) histogram, in linear
+// time. A run of hits split across two bins by the bin edge is counted whole
+// by adding the larger neighbour of the peak bin. The offset of the peak bin
+// is where the clip starts in the song.
+inline OffsetScore scoreOffsets(const std::vector<std::pair<uint32_t, uint32_t>>& times) {
+    std::unordered_map<int64_t, uint32_t> histogram;
+    for (const auto& [sampleTime, dbTime] : times) {
+        int64_t offset = static_cast<int64_t>(dbTime) - static_cast<int64_t>(sampleTime);
+        int64_t bin = offset >= 0 ? offset / OFFSET_BIN_MS : (offset - OFFSET_BIN_MS + 1) / OFFSET_BIN_MS;
+        histogram[bin]++;
+    }
+
+    uint32_t best = 0;
+    int64_t bestBin = 0;
+    for (const auto& [bin, count] : histogram) {
+        auto prev = histogram.find(bin - 1);
+        auto next = histogram.find(bin + 1);
+        uint32_t neighbour = std::max(prev == histogram.end() ? 0u : prev->second,
+                                      next == histogram.end() ? 0u : next->second);
+        uint32_t total = count + neighbour;
+        if (total > best || (total == best && bin < bestBin)) {
+            best = total;
+            bestBin = bin;
+        }
+    }
+    return OffsetScore{static_cast<double>(best), bestBin * OFFSET_BIN_MS};
+}
+
+
+struct Candidate {
+    uint32_t songID;
+    uint32_t hits;
+};
+
+
+// Phase one: raw hit counts per song in a counter array indexed by songID
+// (RegisterSong hands out IDs sequentially, so the array stays dense). The
+// array is reused across queries on a thread and only the touched slots are
+// reset, so the cost follows the number of hits, not the catalog size.
+// A couple of table.addresses[i] counts weights[i] times, once per time the
+// clip has that address, so hits are the number of (clip, song) time pairs.
+// Returns the top MATCH_CANDIDATES songs with at least MIN_CANDIDATE_HITS
+// hits, most hits first.
+inline std::vector<Candidate> selectCandidates(const CoupleTable& table, const std::vector<uint32_t>& weights) {
+    thread_local std::vector<uint32_t> counts;
+    std::vector<uint32_t> touched;
+
+    for (size_t i = 0; i < table.size(); i++) {
+        for (const Couple* couple = table.CouplesBegin(i); couple != table.CouplesEnd(i); ++couple) {
+            if (couple->songID >= counts.size()) {
+                counts.resize(static_cast<size_t>(couple->songID) + 1, 0);
+            }
+            if (counts[couple->songID] == 0) {
+                touched.push_back(couple->songID);
+            }
+            counts[couple->songID] += weights[i];
+        }
+    }
+
+    std::vector<Candidate> candidates;
+    for (uint32_t songID : touched) {
+        if (counts[songID] >= MIN_CANDIDATE_HITS) {
+            candidates.push_back(Candidate{songID, counts[songID]});
+        }
+        counts[songID] = 0;
+    }
+
+    auto byHits = [](const Candidate& a, const Candidate& b) {
+        return a.hits > b.hits || (a.hits == b.hits && a.songID < b.songID);
+    };
+    if (candidates.size() > MATCH_CANDIDATES) {
+        std::partial_sort(candidates.begin(), candidates.begin() + MATCH_CANDIDATES, candidates.end(), byHits);
+        candidates.resize(MATCH_CANDIDATES);
+    } else {
+        std::sort(candidates.begin(), candidates.end(), byHits);
+    }
+    return candidates;
+}
+
+
+// Fingerprints the clip and returns the best maxResults matches, best first.
+// The client must already be connected; it is reused across calls. Song
+// metadata comes from songCache when one is given. A workspace kept by the
+// calling thread saves the DSP buffers from being allocated on every query.
+inline std::vector<Match> FindMatch(DBClient& db, const std::vector<double>& audioSamples, double sampleRate,
+                                    SongCache* songCache = nullptr, size_t maxResults = MAX_MATCH_RESULTS,
+                                    DspWorkspace* workspace = nullptr) {
+    std::vector<FingerprintHash> localHashes;
+    std::vector<FingerprintHash>& fingerprints = workspace ? workspace->hashes : localHashes;
+    FingerprintPipeline pipeline(static_cast<int>(sampleRate),
+        [&](const FingerprintHash& hash) {
+            fingerprints.push_back(hash);
+        }, nullptr, workspace);
+    pipeline.Push(audioSamples);
+    pipeline.Finish();
+    if (pipeline.Frames() == 0) {
+        throw std::runtime_error("Failed to generate spectrogram.");
+    }
+
+    // A repeated address keeps all its clip times; each address is looked up once
+    std::sort(fingerprints.begin(), fingerprints.end(), [](const FingerprintHash& a, const FingerprintHash& b) {
+        return a.address < b.address || (a.address == b.address && a.anchorTimeMs < b.anchorTimeMs);
+    });
+    std::vector<uint32_t> addresses;
+    for (const FingerprintHash& hash : fingerprints) {
+        if (addresses.empty() || addresses.back() != hash.address) {
+            addresses.push_back(hash.address);
+        }
+    }
+
+    auto byAddress = [](const FingerprintHash& hash, uint32_t address) { return hash.address < address; };
+    auto clipTimes = [&](uint32_t address) {
+        auto first = std::lower_bound(fingerprints.begin(), fingerprints.end(), address, byAddress);
+        auto last = first;
+        while (last != fingerprints.end() && last->address == address) ++last;
+        return std::make_pair(first, last);
+    };
+
+
+    auto matchesData = db.GetCouples(addresses);
+    std::vector<uint32_t> weights(matchesData.size());
+    for (size_t i = 0; i < matchesData.size(); i++) {
+        auto [first, last] = clipTimes(matchesData.addresses[i]);
+        weights[i] = static_cast<uint32_t>(last - first);
+    }
+    std::vector<Candidate> candidates = selectCandidates(matchesData, weights);
+
+    // Phase two: offset alignment for the candidates only
+    std::unordered_map<uint32_t, size_t> slot;
+    for (size_t c = 0; c < candidates.size(); c++) {
+        slot[candidates[c].songID] = c;
+    }
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> times(candidates.size());
+    for (size_t i = 0; i < matchesData.size(); i++) {
+        auto [first, last] = clipTimes(matchesData.addresses[i]);
+        for (const Couple* couple = matchesData.CouplesBegin(i); couple != matchesData.CouplesEnd(i); ++couple) {
+            auto it = slot.find(couple->songID);
+            if (it == slot.end()) continue;
+            for (auto hash = first; hash != last; ++hash) {
+                times[it->second].emplace_back(hash->anchorTimeMs, couple->anchorTimeMs);
+            }
+        }
+    }
+
+
+    std::vector<std::pair<uint32_t, OffsetScore>> scored;
+    std::priority_queue<double, std::vector<double>, std::greater<double>> best;  // Top maxResults scores
+
+    for (size_t c = 0; c < candidates.size() && maxResults > 0; c++) {
+        // An aligned score never exceeds the raw hit count, and candidates come
+        // in decreasing hit order: once maxResults scores beat this bound, no
+        // later candidate can enter the results
+        if (best.size() == maxResults && best.top() > candidates[c].hits) break;
+
+        OffsetScore result = scoreOffsets(times[c]);
+        best.push(result.score);
+        if (best.size() > maxResults) best.pop();
+        scored.emplace_back(candidates[c].songID, result);
+    }
+
+    std::stable_sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) {
+        return a.second.score > b.second.score;
+    });
+    if (scored.size() > maxResults) {
+        scored.resize(maxResults);
+    }
+
+
+    // Metadata only for the matches that are returned, in one round-trip
+    std::vector<uint32_t> songIDs;
+    for (const auto& entry : scored) {
+        songIDs.push_back(entry.first);
+    }
+    auto songs = songCache ? songCache->Get(db, songIDs) : db.GetSongsByIDs(songIDs);
+
+    std::vector<Match> matchList;
+    for (size_t i = 0; i < scored.size(); i++) {
+        if (!songs[i]) continue;
+
+        // The clip can start before the song when it has a lead-in
+        uint32_t offsetMs = static_cast<uint32_t>(std::max<int64_t>(scored[i].second.offsetMs, 0));
+        matchList.emplace_back(scored[i].first, songs[i]->title, songs[i]->artist, offsetMs, scored[i].second.score);
+    }
+
+    return matchList;
+}
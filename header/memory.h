@@ -0,0 +1,316 @@
+#ifndef MEMORY_DB_CLIENT_H
+#define MEMORY_DB_CLIENT_H
+
+#include <header/client.h>
+#include <header/utils.h>
+#include <algorithm>
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// DBClient that keeps the whole fingerprint table in process memory.
+//
+// The index is a sorted array of the distinct addresses, each stored as its
+// MixAddress key, and a CSR postings array of packed 8-byte couples: the
+// couples of keys[i] are postings[offsets[i], offsets[i + 1]). A 64K-entry
+// directory on the top 16 key bits narrows each lookup to a short binary
+// search; keying on the mix keeps the buckets even whatever the address
+// layout. New couples are staged and merged into the index in one pass before
+// the next lookup, so loading in bulk costs one sort, not one insertion per
+// posting.
+class MemoryClient : public DBClient {
+private:
+    static const int DIRECTORY_BITS = 16;
+
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> offsets{0};
+    std::vector<Couple> postings;
+    std::vector<uint32_t> directory;
+    std::vector<std::pair<uint32_t, Couple>> staged;
+
+    std::vector<Song> songs;             // indexed by songID
+    std::vector<bool> songExists;
+    std::unordered_map<std::string, uint32_t> songKeys;
+
+    bool connected = false;
+    std::atomic<bool> stagedPending{false};  // Set while staged holds couples
+    mutable std::shared_mutex mutex;
+
+public:
+    bool Connect() override {
+        connected = true;
+        return true;
+    }
+
+    void Disconnect() override {
+        connected = false;
+    }
+
+    bool IsConnected() const override {
+        return connected;
+    }
+
+    bool StoreFingerprints(uint32_t songID, const std::vector<FingerprintHash>& fingerprints) override {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (const FingerprintHash& hash : fingerprints) {
+            staged.emplace_back(MixAddress(hash.address), Couple{hash.anchorTimeMs, songID});
+        }
+        stagedPending = true;
+        return true;
+    }
+
+    // Appends couples without going through a per-song map
+    void BulkLoad(const std::vector<std::pair<uint32_t, Couple>>& couples) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        staged.reserve(staged.size() + couples.size());
+        for (const auto& [address, couple] : couples) {
+            staged.emplace_back(MixAddress(address), couple);
+        }
+        stagedPending = true;
+    }
+
+    void AddCouple(uint32_t address, const Couple& couple) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        staged.emplace_back(MixAddress(address), couple);
+        stagedPending = true;
+    }
+
+    // Lookups share the lock, so queries run side by side. The first one after
+    // a write merges the staged couples under the exclusive lock.
+    CoupleTable GetCouples(const std::vector<uint32_t>& queryAddresses) override {
+        if (stagedPending) {
+            std::unique_lock<std::shared_mutex> writeLock(mutex);
+            mergeStaged();
+        }
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        CoupleTable result;
+        for (uint32_t address : queryAddresses) {
+            size_t index = find(address);
+            if (index == keys.size()) continue;
+
+            result.AddAddress(address);
+            for (uint32_t i = offsets[index]; i < offsets[index + 1]; i++) {
+                result.AddCouple(postings[i]);
+            }
+        }
+        return result;
+    }
+
+    int TotalSongs() override {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return static_cast<int>(songKeys.size());
+    }
+
+    uint32_t RegisterSong(const std::string& songTitle, const std::string& songArtist) override {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        std::string key = GenerateSongKey(songTitle, songArtist);
+        if (songKeys.count(key)) {
+            std::cerr << "Duplicate entry detected for key: " << key << std::endl;
+            return 0;
+        }
+
+        uint32_t songID = static_cast<uint32_t>(std::max<size_t>(songs.size(), 1));
+        putSong(songID, Song{songTitle, songArtist});
+        return songID;
+    }
+
+    // Adds a song under an existing ID, e.g. when loading from another backend
+    void LoadSong(uint32_t songID, const Song& song) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        putSong(songID, song);
+    }
+
+    std::optional<Song> GetSong(const std::string& filterKey, const std::string& value) override {
+        if (filterKey == "_id") {
+            try {
+                return GetSongByID(static_cast<uint32_t>(std::stoul(value)));
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid argument: " << value << " is not a valid integer." << std::endl;
+                return std::nullopt;
+            }
+        }
+        if (filterKey == "key") {
+            return GetSongByKey(value);
+        }
+        std::cerr << "Invalid filter key: " << filterKey << std::endl;
+        return std::nullopt;
+    }
+
+    std::optional<Song> GetSongByID(uint32_t songID) override {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (songID >= songs.size() || !songExists[songID]) return std::nullopt;
+        return songs[songID];
+    }
+
+    std::optional<Song> GetSongByKey(const std::string& key) override {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = songKeys.find(key);
+        if (it == songKeys.end()) return std::nullopt;
+        return songs[it->second];
+    }
+
+    std::vector<std::optional<Song>> GetSongsByIDs(const std::vector<uint32_t>& songIDs) override {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::vector<std::optional<Song>> result(songIDs.size());
+        for (size_t i = 0; i < songIDs.size(); i++) {
+            if (songIDs[i] < songs.size() && songExists[songIDs[i]]) result[i] = songs[songIDs[i]];
+        }
+        return result;
+    }
+
+    bool ExportSongs(const std::function<void(uint32_t songID, const Song& song)>& onSong) override {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for (uint32_t songID = 0; songID < songs.size(); songID++) {
+            if (songExists[songID]) onSong(songID, songs[songID]);
+        }
+        return true;
+    }
+
+    bool DeleteSongByID(uint32_t songID) override {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (songID >= songs.size() || !songExists[songID]) return false;
+        songKeys.erase(GenerateSongKey(songs[songID].title, songs[songID].artist));
+        songExists[songID] = false;
+        return true;
+    }
+
+    // Failed ingests are rare, so this filters the whole table in one pass
+    // rather than editing the CSR arrays per address
+    bool DeleteFingerprints(uint32_t songID, const std::vector<uint32_t>&) override {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        mergeStaged();
+
+        size_t kept = 0, keptKeys = 0;
+        uint32_t begin = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            uint32_t end = offsets[i + 1];
+            size_t first = kept;
+            for (uint32_t j = begin; j < end; j++) {
+                if (postings[j].songID != songID) postings[kept++] = postings[j];
+            }
+            begin = end;
+            if (kept == first) continue;
+            keys[keptKeys] = keys[i];
+            offsets[++keptKeys] = static_cast<uint32_t>(kept);
+        }
+        keys.resize(keptKeys);
+        offsets.resize(keptKeys + 1);
+        postings.resize(kept);
+        rebuildDirectory();
+        return true;
+    }
+
+    bool DeleteCollection(const std::string& collectionName) override {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (collectionName == FingerprintCollectionName(false) || collectionName == FingerprintCollectionName(true)) {
+            keys.clear();
+            offsets.assign(1, 0);
+            postings.clear();
+            directory.clear();
+            staged.clear();
+            stagedPending = false;
+            return true;
+        }
+        if (collectionName == "songs") {
+            songs.clear();
+            songExists.clear();
+            songKeys.clear();
+            return true;
+        }
+        return false;
+    }
+
+    size_t TotalPostings() {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return postings.size() + staged.size();
+    }
+
+private:
+    void putSong(uint32_t songID, const Song& song) {
+        if (songID >= songs.size()) {
+            songs.resize(songID + 1);
+            songExists.resize(songID + 1, false);
+        }
+        songs[songID] = song;
+        songExists[songID] = true;
+        songKeys[GenerateSongKey(song.title, song.artist)] = songID;
+    }
+
+    // Index of the key of `address` in `keys`, or keys.size() if absent
+    size_t find(uint32_t address) const {
+        if (keys.empty()) return keys.size();
+        uint32_t key = MixAddress(address);
+        uint32_t bucket = key >> (32 - DIRECTORY_BITS);
+        auto begin = keys.begin() + directory[bucket];
+        auto end = keys.begin() + directory[bucket + 1];
+        auto it = std::lower_bound(begin, end, key);
+        if (it == end || *it != key) return keys.size();
+        return static_cast<size_t>(it - keys.begin());
+    }
+
+    // Merges the staged couples into the CSR arrays. Couples of one address
+    // keep their insertion order, like $push does in the Mongo backend.
+    void mergeStaged() {
+        if (staged.empty()) return;
+
+        std::stable_sort(staged.begin(), staged.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        std::vector<uint32_t> mergedKeys;
+        std::vector<uint32_t> mergedOffsets{0};
+        std::vector<Couple> mergedPostings;
+        mergedKeys.reserve(keys.size() + staged.size());
+        mergedOffsets.reserve(keys.size() + staged.size() + 1);
+        mergedPostings.reserve(postings.size() + staged.size());
+
+        size_t i = 0, j = 0;
+        while (i < keys.size() || j < staged.size()) {
+            uint32_t key;
+            if (j == staged.size() || (i < keys.size() && keys[i] <= staged[j].first)) {
+                key = keys[i];
+            } else {
+                key = staged[j].first;
+            }
+
+            mergedKeys.push_back(key);
+            if (i < keys.size() && keys[i] == key) {
+                mergedPostings.insert(mergedPostings.end(), postings.begin() + offsets[i], postings.begin() + offsets[i + 1]);
+                i++;
+            }
+            while (j < staged.size() && staged[j].first == key) {
+                mergedPostings.push_back(staged[j].second);
+                j++;
+            }
+            mergedOffsets.push_back(static_cast<uint32_t>(mergedPostings.size()));
+        }
+
+        keys = std::move(mergedKeys);
+        offsets = std::move(mergedOffsets);
+        postings = std::move(mergedPostings);
+        staged.clear();
+        staged.shrink_to_fit();
+        stagedPending = false;
+
+        rebuildDirectory();
+    }
+
+    // First key index of each top-DIRECTORY_BITS bucket
+    void rebuildDirectory() {
+        directory.assign((size_t(1) << DIRECTORY_BITS) + 1, 0);
+        for (uint32_t key : keys) {
+            directory[(key >> (32 - DIRECTORY_BITS)) + 1]++;
+        }
+        for (size_t b = 1; b < directory.size(); b++) {
+            directory[b] += directory[b - 1];
+        }
+    }
+};
+
+#endif
@@ -1,13 +1,15 @@
 #include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
 #pragma once
-#include <complex>
-
-using Complex = std::complex<double>;
 
+// A spectrogram peak: the analysis frame it was found in, its frequency bin
+// and its magnitude. Times are derived from the frame index when needed.
 struct Peak {
-    double time;
-    Complex freq;
+    uint32_t frame;
+    uint16_t bin;
+    float magnitude;
 };
 
 
@@ -16,6 +18,62 @@ struct Couple {
     uint32_t songID;
 };
 
+// Layout of FingerprintHash::address (see createAddress). Version 1 packed the
+// real part of the FFT coefficient and a millisecond delta; version 2 packs
+// bin indices and a frame delta, with field widths set by the fingerprint
+// preset (see fingerprintconfig.h). Stores keep versions and presets apart.
+#define FINGERPRINT_HASH_VERSION 2
+
+// One anchor/target pair of a track. A track can produce the same address
+// more than once, so these are kept in a flat list, not keyed by address.
+struct FingerprintHash {
+    uint32_t address;
+    uint32_t anchorTimeMs;
+};
+
+// Couples of several addresses in three flat arrays (CSR layout): the couples
+// of addresses[i] are couples[offsets[i], offsets[i + 1]).
+struct CoupleTable {
+    std::vector<uint32_t> addresses;
+    std::vector<uint32_t> offsets{0};
+    std::vector<Couple> couples;
+
+    size_t size() const { return addresses.size(); }
+    bool empty() const { return addresses.empty(); }
+
+    const Couple* CouplesBegin(size_t i) const { return couples.data() + offsets[i]; }
+    const Couple* CouplesEnd(size_t i) const { return couples.data() + offsets[i + 1]; }
+
+    // Starts a new address; couples added afterwards belong to it
+    void AddAddress(uint32_t address) {
+        addresses.push_back(address);
+        offsets.push_back(static_cast<uint32_t>(couples.size()));
+    }
+
+    void AddCouple(const Couple& couple) {
+        couples.push_back(couple);
+        offsets.back() = static_cast<uint32_t>(couples.size());
+    }
+
+    // Appends `count` couples stored back to back, e.g. a packed BSON binary;
+    // `bytes` need not be aligned
+    void AddPackedCouples(const void* bytes, size_t count) {
+        size_t start = couples.size();
+        couples.resize(start + count);
+        std::memcpy(couples.data() + start, bytes, count * sizeof(Couple));
+        offsets.back() = static_cast<uint32_t>(couples.size());
+    }
+
+    void Append(const CoupleTable& other) {
+        uint32_t base = static_cast<uint32_t>(couples.size());
+        addresses.insert(addresses.end(), other.addresses.begin(), other.addresses.end());
+        for (size_t i = 1; i < other.offsets.size(); i++) {
+            offsets.push_back(base + other.offsets[i]);
+        }
+        couples.insert(couples.end(), other.couples.begin(), other.couples.end());
+    }
+};
+
 struct RecordData {
     std::string audio;
     double duration;
@@ -3,24 +3,58 @@
 
 #include <header/client.h>
 #include <mongocxx/client.hpp>
+#include <mongocxx/pool.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/model/replace_one.hpp>
+#include <mongocxx/options/find_one_and_update.hpp>
+#include <mongocxx/options/update.hpp>
 #include <mongocxx/exception/exception.hpp>
 #include <bsoncxx/json.hpp>
 #include <bsoncxx/string/to_string.hpp> 
 #include <bsoncxx/builder/stream/document.hpp>
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
 #include <string>
 #include <vector>
 #include <map>
 #include <optional>
+#include <future>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
 
 
 
+// Thread-safe: every operation checks a connection out of a mongocxx::pool,
+// so one MongoClient can be shared by all ingest and query threads.
 class MongoClient : public DBClient {
 private:
     uint32_t num = 1;
-    mongocxx::client client;
-    mongocxx::database db;
-    bool connected;
+    std::unique_ptr<mongocxx::pool> pool;
+    std::mutex connectMutex;
+    std::atomic<bool> connected;
+    std::atomic<int64_t> poolAcquires{0};
+    std::atomic<int64_t> poolWaitNs{0};
+    std::atomic<int64_t> poolMaxWaitNs{0};
+    size_t bulkBatchSize;
+    size_t writeConnections;
+    size_t lookupChunkSize;
+    size_t readConnections;
+    int64_t poolWaitTimeoutMs;
+    int64_t idBlockSize;
+    std::string fingerprintCollection;
+    std::optional<std::string> baseUri;  // Unset: built from the DB_* variables
+    std::string database;
+    std::mutex idMutex;
+    int64_t nextSongID = 0;
+    int64_t songIDLimit = 0;
     
 
     static mongocxx::instance& getInstance() {
@@ -29,15 +63,32 @@ private:
     }
     
 public:
-    MongoClient(const std::string& uri) : connected(false) {
+    // A URI, e.g. one shard of DB_SHARD_URIS, is used as given; without one
+    // the connection is configured from the DB_* variables. Benchmarks pass
+    // a scratch database.
+    explicit MongoClient(std::optional<std::string> uri = std::nullopt, std::string databaseName = "song-recognition")
+        : connected(false), baseUri(std::move(uri)), database(std::move(databaseName)) {
         getInstance();
+        bulkBatchSize = std::max(1, std::atoi(getEnv("DB_BULK_BATCH_SIZE", "1000").c_str()));
+        writeConnections = std::max(1, std::atoi(getEnv("DB_WRITE_CONNECTIONS", "1").c_str()));
+        lookupChunkSize = std::max(1, std::atoi(getEnv("DB_LOOKUP_CHUNK_SIZE", "1000").c_str()));
+        readConnections = std::max(1, std::atoi(getEnv("DB_READ_CONNECTIONS", "1").c_str()));
+        poolWaitTimeoutMs = std::max(0, std::atoi(getEnv("DB_POOL_WAIT_TIMEOUT_MS", "0").c_str()));
+        idBlockSize = std::max(1, std::atoi(getEnv("DB_ID_BLOCK_SIZE", "1").c_str()));
+        fingerprintCollection = FingerprintCollectionName(getEnv("DB_FINGERPRINT_SCHEMA", "documents") == "packed");
     }
     
     bool Connect() override {
+        std::lock_guard<std::mutex> lock(connectMutex);
+        if (connected) return true;
+
         try {
             mongocxx::uri uri(getConnectionUri());
-            client = mongocxx::client(uri);
-            db = client["song-recognition"];
+            pool = std::make_unique<mongocxx::pool>(uri);
+            if (!ensureSchema()) {
+                pool.reset();
+                return false;
+            }
             connected = true;
             return true;
         } catch (const std::exception& e) {
@@ -46,80 +97,92 @@ public:
         }
     }
     
+    // Must not race with calls still using the pool
     void Disconnect() override {
-
+        std::lock_guard<std::mutex> lock(connectMutex);
         connected = false;
+        pool.reset();
     }
     
     bool IsConnected() const override {
         return connected;
     }
     
-    bool StoreFingerprints(const std::unordered_map<uint32_t, Couple>& fingerprints) override {
+    bool StoreFingerprints(uint32_t songID, const std::vector<FingerprintHash>& fingerprints) override {
         if (!connected) return false;
-        
-        auto collection = db["fingerprints"];
-        
-        try {
-            for (const auto& [address, couple] : fingerprints) {
-                using namespace bsoncxx::builder::stream;
-                
-                document filter_builder, update_builder;
-                filter_builder << "_id" << static_cast<int64_t>(address);
-                
-                update_builder << "$push" << open_document
-                              << "couples" << open_document
-                              << "anchorTimeMs" << static_cast<int64_t>(couple.anchorTimeMs)
-                              << "songID" << static_cast<int64_t>(couple.songID)
-                              << close_document
-                              << close_document;
-                
-                mongocxx::options::update options;
-                options.upsert(true);
-                
-                collection.update_one(filter_builder.view(), update_builder.view(), options);
+
+        // Repeated addresses of the track go into one update of their document
+        std::vector<Couple> couples;
+        std::vector<std::pair<uint32_t, size_t>> groups;
+        couples.reserve(fingerprints.size());
+        std::vector<FingerprintHash> sorted(fingerprints);
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const FingerprintHash& a, const FingerprintHash& b) { return a.address < b.address; });
+        for (const FingerprintHash& hash : sorted) {
+            if (groups.empty() || groups.back().first != hash.address) {
+                groups.emplace_back(hash.address, couples.size());
             }
-            return true;
-        } catch (const std::exception& e) {
-            std::cerr << "Error storing fingerprints: " << e.what() << std::endl;
-            return false;
+            couples.push_back(Couple{hash.anchorTimeMs, songID});
+        }
+        groups.emplace_back(0, couples.size());
+
+        size_t count = groups.size() - 1;
+        size_t slices = std::min(writeConnections, (count + bulkBatchSize - 1) / bulkBatchSize);
+        if (slices <= 1) {
+            return storeFingerprintRange(groups.data(), count, couples.data());
         }
+
+        // Extra slices are written in parallel, each over its own pooled connection
+        size_t sliceSize = (count + slices - 1) / slices;
+        slices = (count + sliceSize - 1) / sliceSize;
+        std::vector<std::future<bool>> pending;
+        for (size_t i = 1; i < slices; i++) {
+            const std::pair<uint32_t, size_t>* begin = groups.data() + i * sliceSize;
+            size_t sliceCount = std::min(sliceSize, count - i * sliceSize);
+            pending.push_back(std::async(std::launch::async, [this, begin, sliceCount, &couples]() {
+                return storeFingerprintRange(begin, sliceCount, couples.data());
+            }));
+        }
+
+        bool success = storeFingerprintRange(groups.data(), sliceSize, couples.data());
+        for (auto& result : pending) {
+            success = result.get() && success;
+        }
+        return success;
     }
     
-    std::map<uint32_t, std::vector<Couple>> GetCouples(const std::vector<uint32_t>& addresses) override {
-        std::map<uint32_t, std::vector<Couple>> result;
+    CoupleTable GetCouples(const std::vector<uint32_t>& addresses) override {
+        CoupleTable result;
         
         if (!connected) return result;
-        
-        auto collection = db["fingerprints"];
-        
-        for (const auto& address : addresses) {
-            try {
-                using namespace bsoncxx::builder::stream;
-                document filter_builder;
-                filter_builder << "_id" << static_cast<int64_t>(address);
-                
-                auto doc = collection.find_one(filter_builder.view());
-                if (doc) {
-                    auto doc_view = doc->view();
-                    auto couples_array = doc_view["couples"].get_array().value;
-                    
-                    std::vector<Couple> couples;
-                    for (const auto& element : couples_array) {
-                        auto couple_doc = element.get_document().value;
-                        Couple couple;
-                        couple.anchorTimeMs = static_cast<uint32_t>(couple_doc["anchorTimeMs"].get_int64().value);
-                        couple.songID = static_cast<uint32_t>(couple_doc["songID"].get_int64().value);
-                        couples.push_back(couple);
-                    }
-                    
-                    result[address] = couples;
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "Error retrieving couples for address " << address << ": " << e.what() << std::endl;
-            }
+
+        // Addresses are looked up lookupChunkSize at a time with $in queries;
+        // extra read connections each take a contiguous share of the chunks
+        size_t chunks = (addresses.size() + lookupChunkSize - 1) / lookupChunkSize;
+        size_t slices = std::min(readConnections, chunks);
+        if (slices <= 1) {
+            fetchCoupleRange(addresses.data(), addresses.size(), result);
+            return result;
+        }
+
+        size_t chunksPerSlice = (chunks + slices - 1) / slices;
+        size_t sliceSize = chunksPerSlice * lookupChunkSize;
+        slices = (chunks + chunksPerSlice - 1) / chunksPerSlice;
+        std::vector<std::future<CoupleTable>> pending;
+        for (size_t i = 1; i < slices; i++) {
+            const uint32_t* begin = addresses.data() + i * sliceSize;
+            size_t count = std::min(sliceSize, addresses.size() - i * sliceSize);
+            pending.push_back(std::async(std::launch::async, [this, begin, count]() {
+                CoupleTable slice;
+                fetchCoupleRange(begin, count, slice);
+                return slice;
+            }));
+        }
+
+        fetchCoupleRange(addresses.data(), std::min(sliceSize, addresses.size()), result);
+        for (auto& slice : pending) {
+            result.Append(slice.get());
         }
-        
         return result;
     }
     
@@ -127,6 +190,8 @@ public:
         if (!connected) return 0;
         
         try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
             auto collection = db["songs"];
             return static_cast<int>(collection.count_documents({}));
         } catch (const std::exception& e) {
@@ -139,25 +204,10 @@ public:
         if (!connected) return 0;
 
         try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
             auto collection = db["songs"];
-            
-            bsoncxx::builder::stream::document index_builder;
-            index_builder << "key" << 1;  
-            bsoncxx::document::view_or_value index_doc{index_builder.view()};
-            mongocxx::options::index index_options;
-            index_options.unique(true);  
-            collection.create_index(index_doc, index_options);
-            auto result = collection.find_one({}, mongocxx::options::find{}
-            .sort(bsoncxx::builder::stream::document{} << "_id" << -1 << bsoncxx::builder::stream::finalize));
-            int32_t songID = 1;  
-                    if (result) {
-                        auto doc = result->view();
-                        if (doc["_id"].type() == bsoncxx::type::k_int32) {
-                            songID = doc["_id"].get_int32() + 1;
-                        } else if (doc["_id"].type() == bsoncxx::type::k_int64) {
-                            songID = static_cast<int32_t>(doc["_id"].get_int64() + 1);
-                        }
-                    }
+            uint32_t songID = allocateSongID(db);
             std::string key = generateSongKey(songTitle, songArtist);
 
             bsoncxx::builder::stream::document doc_builder;
@@ -173,6 +223,9 @@ public:
                 std::cerr << "Duplicate entry detected for key: " << generateSongKey(songTitle, songArtist) << std::endl;
             }
             return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error registering song: " << e.what() << std::endl;
+            return 0;
         }
     }
     
@@ -187,6 +240,8 @@ public:
         }
         
         try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
             auto collection = db["songs"];
             
             using namespace bsoncxx::builder::stream;
@@ -214,12 +269,7 @@ public:
                 if (key_elem && key_elem.type() == bsoncxx::type::k_string) {
                     
                     std::string key = bsoncxx::string::to_string(key_elem.get_string().value);
-
-                    size_t separatorPos = key.find("---");
-                    std::string title = (separatorPos != std::string::npos) ? key.substr(0, separatorPos) : key;
-                    std::string artist = (separatorPos != std::string::npos) ? key.substr(separatorPos + 3) : "";
-
-                    return Song{title, artist};  
+                    return parseSongKey(key);
                 }
             }
 
@@ -238,11 +288,51 @@ public:
     std::optional<Song> GetSongByKey(const std::string& key) override {
         return GetSong("key", key);
     }
+
+    std::vector<std::optional<Song>> GetSongsByIDs(const std::vector<uint32_t>& songIDs) override {
+        std::vector<std::optional<Song>> songs(songIDs.size());
+        if (!connected || songIDs.empty()) return songs;
+
+        try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
+            using namespace bsoncxx::builder::stream;
+
+            bsoncxx::builder::basic::array ids;
+            for (uint32_t songID : songIDs) {
+                ids.append(static_cast<int64_t>(songID));
+            }
+            auto filter = document{} << "_id" << open_document
+                                     << "$in" << bsoncxx::types::b_array{ids.view()}
+                                     << close_document << finalize;
+
+            std::unordered_map<uint32_t, Song> found;
+            for (auto&& doc : db["songs"].find(filter.view())) {
+                auto id_elem = doc["_id"];
+                auto key_elem = doc["key"];
+                if (!key_elem || key_elem.type() != bsoncxx::type::k_string) continue;
+
+                uint32_t songID = id_elem.type() == bsoncxx::type::k_int32
+                    ? static_cast<uint32_t>(id_elem.get_int32().value)
+                    : static_cast<uint32_t>(id_elem.get_int64().value);
+                found[songID] = parseSongKey(bsoncxx::string::to_string(key_elem.get_string().value));
+            }
+            for (size_t i = 0; i < songIDs.size(); i++) {
+                auto it = found.find(songIDs[i]);
+                if (it != found.end()) songs[i] = it->second;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error retrieving " << songIDs.size() << " songs: " << e.what() << std::endl;
+        }
+        return songs;
+    }
     
     bool DeleteSongByID(uint32_t songID) override {
         if (!connected) return false;
         
         try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
             auto collection = db["songs"];
             
             using namespace bsoncxx::builder::stream;
@@ -258,10 +348,61 @@ public:
         }
     }
     
+    // Documents drop the song's couples with $pull. Packed blobs cannot be
+    // edited in place, so each document is decoded, filtered and replaced only
+    // if it is unchanged since it was read; documents that changed meanwhile
+    // are read again.
+    bool DeleteFingerprints(uint32_t songID, const std::vector<uint32_t>& addresses) override {
+        if (!connected) return false;
+
+        std::vector<uint32_t> unique(addresses);
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+        bool packed = fingerprintCollection == FingerprintCollectionName(true);
+
+        try {
+            using namespace bsoncxx::builder::stream;
+            auto entry = acquire();
+            auto collection = (*entry)[database][fingerprintCollection];
+
+            for (size_t offset = 0; offset < unique.size(); offset += bulkBatchSize) {
+                size_t count = std::min(bulkBatchSize, unique.size() - offset);
+                if (packed) {
+                    bool done = false;
+                    for (int attempt = 0; attempt < 3 && !done; attempt++) {
+                        done = pullPackedCouples(collection, songID, unique.data() + offset, count);
+                    }
+                    if (!done) return false;
+                    continue;
+                }
+
+                mongocxx::options::bulk_write options;
+                options.ordered(false);
+                auto bulk = collection.create_bulk_write(options);
+                for (size_t i = offset; i < offset + count; i++) {
+                    auto filter = document{} << "_id" << static_cast<int64_t>(unique[i]) << finalize;
+                    auto update = document{} << "$pull" << open_document
+                                             << "couples" << open_document
+                                             << "songID" << static_cast<int64_t>(songID)
+                                             << close_document
+                                             << close_document << finalize;
+                    bulk.append(mongocxx::model::update_one{filter.view(), update.view()});
+                }
+                bulk.execute();
+            }
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Error deleting fingerprints of song " << songID << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
     bool DeleteCollection(const std::string& collectionName) override {
         if (!connected) return false;
         
         try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
             db[collectionName].drop();
             return true;
         } catch (const std::exception& e) {
@@ -270,8 +411,469 @@ public:
         }
     }
     
+    // Streams every stored couple, e.g. to bulk-load another backend
+    bool ExportFingerprints(const std::function<void(uint32_t address, const Couple& couple)>& onCouple) {
+        if (!connected) return false;
+
+        try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
+            for (auto&& doc : db[fingerprintCollection].find({})) {
+                uint32_t address = static_cast<uint32_t>(doc["_id"].get_int64().value);
+                CoupleTable couples;
+                couples.AddAddress(address);
+                decodeCouples(doc, couples);
+                for (const Couple& couple : couples.couples) {
+                    onCouple(address, couple);
+                }
+            }
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Error exporting fingerprints: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    bool ExportSongs(const std::function<void(uint32_t songID, const Song& song)>& onSong) override {
+        if (!connected) return false;
+
+        try {
+            auto entry = acquire();
+            auto db = (*entry)[database];
+            for (auto&& doc : db["songs"].find({})) {
+                auto id_elem = doc["_id"];
+                auto key_elem = doc["key"];
+                if (!key_elem || key_elem.type() != bsoncxx::type::k_string) continue;
+
+                uint32_t songID = 0;
+                if (id_elem.type() == bsoncxx::type::k_int32) {
+                    songID = static_cast<uint32_t>(id_elem.get_int32().value);
+                } else if (id_elem.type() == bsoncxx::type::k_int64) {
+                    songID = static_cast<uint32_t>(id_elem.get_int64().value);
+                } else {
+                    continue;
+                }
+                onSong(songID, parseSongKey(bsoncxx::string::to_string(key_elem.get_string().value)));
+            }
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Error exporting songs: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    
+    // Rewrites every address of collection `from` as a single packed blob in
+    // `to`, sorted by songID. from == to compacts the appended blobs of a packed
+    // collection in place. Either schema can be read.
+    //
+    // Ingest may keep running: blobs already in `to`, from an earlier run or
+    // appended since, are merged with the source couples rather than
+    // overwritten, and a document that changes between the read and the
+    // replace is read again. Identical couples are stored once, so re-running
+    // a migration does not double its postings.
+    bool MigrateFingerprints(const std::string& from, const std::string& to, size_t& migrated) {
+        migrated = 0;
+        if (!connected) return false;
+
+        try {
+            using namespace bsoncxx::builder::stream;
+            bool compact = from == to;
+            auto readEntry = acquire();
+            auto writeEntry = acquire();
+            auto source = (*readEntry)[database][from];
+            auto target = (*writeEntry)[database][to];
+
+            // Compaction reads each document when it rewrites it, so the scan
+            // only needs the addresses
+            mongocxx::options::find scan;
+            if (compact) scan.projection(document{} << "_id" << 1 << finalize);
+
+            std::vector<std::pair<uint32_t, std::vector<Couple>>> batch;
+            auto flush = [&]() {
+                bool done = false;
+                for (int attempt = 0; attempt < 3 && !done; attempt++) {
+                    done = repackCouples(target, batch);
+                }
+                if (!done) throw std::runtime_error("fingerprints kept changing during the migration");
+                migrated += batch.size();
+                batch.clear();
+            };
+
+            for (auto&& doc : source.find({}, scan)) {
+                CoupleTable couples;
+                couples.AddAddress(static_cast<uint32_t>(doc["_id"].get_int64().value));
+                if (!compact) decodeCouples(doc, couples);
+                batch.emplace_back(couples.addresses[0], std::move(couples.couples));
+                if (batch.size() == bulkBatchSize) flush();
+            }
+            if (!batch.empty()) flush();
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Error migrating fingerprints: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    // On-disk size of a collection in bytes, or -1 if unknown
+    int64_t StorageSize(const std::string& collectionName) {
+        if (!connected) return -1;
+
+        try {
+            using namespace bsoncxx::builder::stream;
+            auto entry = acquire();
+            auto stats = (*entry)[database].run_command(document{} << "collStats" << collectionName << finalize);
+            auto size = stats.view()["storageSize"];
+            if (size.type() == bsoncxx::type::k_int32) return size.get_int32().value;
+            if (size.type() == bsoncxx::type::k_int64) return size.get_int64().value;
+            if (size.type() == bsoncxx::type::k_double) return static_cast<int64_t>(size.get_double().value);
+        } catch (const std::exception& e) {
+            std::cerr << "Error reading collection stats: " << e.what() << std::endl;
+        }
+        return -1;
+    }
+
+    // Connection pool wait times; high values mean DB_POOL_SIZE is too small
+    // for the number of threads sharing this client
+    std::map<std::string, double> Metrics() override {
+        int64_t acquires = poolAcquires;
+        return {
+            {"pool_acquires", static_cast<double>(acquires)},
+            {"pool_wait_ms_total", poolWaitNs / 1e6},
+            {"pool_wait_ms_avg", acquires > 0 ? poolWaitNs / 1e6 / acquires : 0.0},
+            {"pool_wait_ms_max", poolMaxWaitNs / 1e6},
+        };
+    }
+    
 private:
+    // Checks a connection out of the pool; it goes back when the entry is
+    // destroyed. Waits at most poolWaitTimeoutMs when that is set.
+    mongocxx::pool::entry acquire() {
+        auto start = std::chrono::steady_clock::now();
+        mongocxx::pool::entry entry = poolWaitTimeoutMs > 0 ? acquireWithTimeout(start) : pool->acquire();
+        int64_t waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        poolAcquires++;
+        poolWaitNs += waitNs;
+        int64_t maxWait = poolMaxWaitNs;
+        while (waitNs > maxWait && !poolMaxWaitNs.compare_exchange_weak(maxWait, waitNs)) {}
+        return entry;
+    }
+
+    mongocxx::pool::entry acquireWithTimeout(std::chrono::steady_clock::time_point start) {
+        auto deadline = start + std::chrono::milliseconds(poolWaitTimeoutMs);
+        while (true) {
+            if (auto entry = pool->try_acquire()) {
+                return std::move(*entry);
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                throw std::runtime_error("Timed out waiting for a pooled connection");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // One-time setup when a client connects: the unique index on song keys and
+    // the song ID counter, seeded from the highest existing ID. Without them
+    // IDs could be handed out twice, so a failure here fails Connect.
+    bool ensureSchema() {
+        try {
+            using namespace bsoncxx::builder::stream;
+            auto entry = acquire();
+            auto db = (*entry)[database];
+
+            mongocxx::options::index index_options;
+            index_options.unique(true);
+            db["songs"].create_index(document{} << "key" << 1 << finalize, index_options);
+
+            int64_t maxID = 0;
+            auto result = db["songs"].find_one({}, mongocxx::options::find{}
+                .sort(document{} << "_id" << -1 << finalize));
+            if (result) {
+                auto id = result->view()["_id"];
+                if (id.type() == bsoncxx::type::k_int32) {
+                    maxID = id.get_int32().value;
+                } else if (id.type() == bsoncxx::type::k_int64) {
+                    maxID = id.get_int64().value;
+                }
+            }
+
+            mongocxx::options::update upsert;
+            upsert.upsert(true);
+            db["counters"].update_one(document{} << "_id" << "songID" << finalize,
+                                      document{} << "$max" << open_document << "value" << maxID << close_document << finalize,
+                                      upsert);
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Error setting up the database schema: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    // Song IDs come from an atomic $inc on the counter document, so concurrent
+    // ingests in any number of processes never hand out the same ID. With
+    // DB_ID_BLOCK_SIZE > 1 a client reserves IDs a block at a time and hands
+    // them out locally; IDs left in a block when the process exits are skipped.
+    uint32_t allocateSongID(mongocxx::database& db) {
+        std::lock_guard<std::mutex> lock(idMutex);
+        if (nextSongID < songIDLimit) {
+            return static_cast<uint32_t>(nextSongID++);
+        }
+
+        using namespace bsoncxx::builder::stream;
+        mongocxx::options::find_one_and_update options;
+        options.upsert(true);
+        options.return_document(mongocxx::options::return_document::k_after);
+        auto result = db["counters"].find_one_and_update(
+            document{} << "_id" << "songID" << finalize,
+            document{} << "$inc" << open_document << "value" << idBlockSize << close_document << finalize,
+            options);
+        if (!result) {
+            throw std::runtime_error("Song ID counter is missing");
+        }
+
+        auto value = result->view()["value"];
+        songIDLimit = value.type() == bsoncxx::type::k_int32 ? value.get_int32().value + 1
+                                                             : value.get_int64().value + 1;
+        nextSongID = songIDLimit - idBlockSize;
+        return static_cast<uint32_t>(nextSongID++);
+    }
+
+    // Couples as one BSON binary of packed little-endian Couple structs
+    static bsoncxx::types::b_binary packCouples(const Couple* couples, size_t count) {
+        return bsoncxx::types::b_binary{bsoncxx::binary_sub_type::k_binary,
+                                        static_cast<uint32_t>(count * sizeof(Couple)),
+                                        reinterpret_cast<const uint8_t*>(couples)};
+    }
+
+    // Appends the couples of one fingerprint document. Packed documents hold an
+    // array of blobs in "p": one per address after migration, plus one per
+    // song batch stored since; each decodes with a plain copy. Documents in the
+    // original schema hold "couples".
+    static void decodeCouples(const bsoncxx::document::view& doc, CoupleTable& table) {
+        auto packed = doc["p"];
+        if (packed) {
+            for (const auto& element : packed.get_array().value) {
+                auto blob = element.get_binary();
+                table.AddPackedCouples(blob.bytes, blob.size / sizeof(Couple));
+            }
+            return;
+        }
+
+        for (const auto& element : doc["couples"].get_array().value) {
+            auto couple_doc = element.get_document().value;
+            Couple couple;
+            couple.anchorTimeMs = static_cast<uint32_t>(couple_doc["anchorTimeMs"].get_int64().value);
+            couple.songID = static_cast<uint32_t>(couple_doc["songID"].get_int64().value);
+            table.AddCouple(couple);
+        }
+    }
+
+    static Song parseSongKey(const std::string& key) {
+        size_t separatorPos = key.find("---");
+        std::string title = (separatorPos != std::string::npos) ? key.substr(0, separatorPos) : key;
+        std::string artist = (separatorPos != std::string::npos) ? key.substr(separatorPos + 3) : "";
+        return Song{title, artist};
+    }
+
+    // One pass of DeleteFingerprints over packed documents. Returns false if a
+    // document changed between the read and the replace.
+    bool pullPackedCouples(mongocxx::collection& collection, uint32_t songID, const uint32_t* addresses, size_t count) {
+        using namespace bsoncxx::builder::stream;
+        bsoncxx::builder::basic::array ids;
+        for (size_t i = 0; i < count; i++) {
+            ids.append(static_cast<int64_t>(addresses[i]));
+        }
+        auto query = document{} << "_id" << open_document
+                                << "$in" << bsoncxx::types::b_array{ids.view()}
+                                << close_document << finalize;
+
+        mongocxx::options::bulk_write options;
+        options.ordered(false);
+        auto bulk = collection.create_bulk_write(options);
+        int32_t replacements = 0;
+        for (auto&& doc : collection.find(query.view())) {
+            CoupleTable couples;
+            couples.AddAddress(static_cast<uint32_t>(doc["_id"].get_int64().value));
+            decodeCouples(doc, couples);
+            std::vector<Couple> kept;
+            for (const Couple& couple : couples.couples) {
+                if (couple.songID != songID) kept.push_back(couple);
+            }
+            if (kept.size() == couples.couples.size()) continue;
+
+            auto filter = document{} << "_id" << doc["_id"].get_int64()
+                                     << "p" << bsoncxx::types::b_array{doc["p"].get_array().value} << finalize;
+            auto replacement = document{} << "p" << open_array
+                                          << packCouples(kept.data(), kept.size())
+                                          << close_array << finalize;
+            bulk.append(mongocxx::model::replace_one{filter.view(), replacement.view()});
+            replacements++;
+        }
+        if (replacements == 0) return true;
+        auto result = bulk.execute();
+        return result && result->matched_count() == replacements;
+    }
+
+    // One pass of MigrateFingerprints over a batch of addresses and their
+    // source couples. Each document of `target` is replaced by one sorted blob
+    // of its couples merged with the batch's, only if it is unchanged since it
+    // was read. Addresses with no document are inserted with $setOnInsert, so
+    // one created meanwhile is left alone. Returns false if a document changed
+    // or appeared between the read and the write.
+    bool repackCouples(mongocxx::collection& target, std::vector<std::pair<uint32_t, std::vector<Couple>>>& batch) {
+        using namespace bsoncxx::builder::stream;
+        std::sort(batch.begin(), batch.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        bsoncxx::builder::basic::array ids;
+        for (const auto& entry : batch) {
+            ids.append(static_cast<int64_t>(entry.first));
+        }
+        auto query = document{} << "_id" << open_document
+                                << "$in" << bsoncxx::types::b_array{ids.view()}
+                                << close_document << finalize;
+
+        auto repack = [](std::vector<Couple>& couples) {
+            std::sort(couples.begin(), couples.end(), [](const Couple& a, const Couple& b) {
+                return a.songID < b.songID || (a.songID == b.songID && a.anchorTimeMs < b.anchorTimeMs);
+            });
+            couples.erase(std::unique(couples.begin(), couples.end(), [](const Couple& a, const Couple& b) {
+                return a.songID == b.songID && a.anchorTimeMs == b.anchorTimeMs;
+            }), couples.end());
+            return document{} << "p" << open_array << packCouples(couples.data(), couples.size())
+                              << close_array << finalize;
+        };
+
+        mongocxx::options::bulk_write options;
+        options.ordered(false);
+        auto bulk = target.create_bulk_write(options);
+        std::vector<bool> found(batch.size(), false);
+        int32_t replacements = 0;
+        for (auto&& doc : target.find(query.view())) {
+            uint32_t address = static_cast<uint32_t>(doc["_id"].get_int64().value);
+            auto entry = std::lower_bound(batch.begin(), batch.end(), address,
+                                          [](const auto& a, uint32_t b) { return a.first < b; });
+            if (entry == batch.end() || entry->first != address) continue;
+            found[entry - batch.begin()] = true;
+
+            CoupleTable couples;
+            couples.AddAddress(address);
+            decodeCouples(doc, couples);
+            couples.couples.insert(couples.couples.end(), entry->second.begin(), entry->second.end());
+
+            auto filter = document{} << "_id" << doc["_id"].get_int64()
+                                     << "p" << bsoncxx::types::b_array{doc["p"].get_array().value} << finalize;
+            auto replacement = repack(couples.couples);
+            bulk.append(mongocxx::model::replace_one{filter.view(), replacement.view()});
+            replacements++;
+        }
+
+        int32_t inserts = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            // Compaction only rewrites documents that still exist
+            if (found[i] || batch[i].second.empty()) continue;
+            auto filter = document{} << "_id" << static_cast<int64_t>(batch[i].first) << finalize;
+            auto fields = repack(batch[i].second);
+            auto update = document{} << "$setOnInsert" << bsoncxx::types::b_document{fields.view()} << finalize;
+            mongocxx::model::update_one insert{filter.view(), update.view()};
+            insert.upsert(true);
+            bulk.append(insert);
+            inserts++;
+        }
+
+        if (replacements == 0 && inserts == 0) return true;
+        auto result = bulk.execute();
+        return result && result->matched_count() == replacements && result->upserted_count() == inserts;
+    }
+
+    // Upserts `count` addresses with unordered bulk writes of bulkBatchSize
+    // operations. groups[i] holds an address and the index of its first couple
+    // in `couples`; its couples run up to the start of groups[i + 1].
+    bool storeFingerprintRange(const std::pair<uint32_t, size_t>* groups, size_t count, const Couple* couples) {
+        try {
+            using namespace bsoncxx::builder::stream;
+            auto entry = acquire();
+            auto collection = (*entry)[database][fingerprintCollection];
+            bool packed = fingerprintCollection == FingerprintCollectionName(true);
+
+            for (size_t offset = 0; offset < count; offset += bulkBatchSize) {
+                mongocxx::options::bulk_write options;
+                options.ordered(false);
+                auto bulk = collection.create_bulk_write(options);
+
+                size_t end = std::min(count, offset + bulkBatchSize);
+                for (size_t i = offset; i < end; i++) {
+                    uint32_t address = groups[i].first;
+                    const Couple* first = couples + groups[i].second;
+                    const Couple* last = couples + groups[i + 1].second;
+
+                    auto filter = document{} << "_id" << static_cast<int64_t>(address) << finalize;
+                    bsoncxx::document::value update = document{} << finalize;
+                    if (packed) {
+                        update = document{} << "$push" << open_document
+                                            << "p" << packCouples(first, static_cast<size_t>(last - first))
+                                            << close_document << finalize;
+                    } else {
+                        bsoncxx::builder::basic::array each;
+                        for (const Couple* couple = first; couple != last; couple++) {
+                            each.append(bsoncxx::builder::basic::make_document(
+                                bsoncxx::builder::basic::kvp("anchorTimeMs", static_cast<int64_t>(couple->anchorTimeMs)),
+                                bsoncxx::builder::basic::kvp("songID", static_cast<int64_t>(couple->songID))));
+                        }
+                        update = document{} << "$push" << open_document
+                                            << "couples" << open_document
+                                            << "$each" << bsoncxx::types::b_array{each.view()}
+                                            << close_document
+                                            << close_document << finalize;
+                    }
+
+                    mongocxx::model::update_one upsert{filter.view(), update.view()};
+                    upsert.upsert(true);
+                    bulk.append(upsert);
+                }
+                bulk.execute();
+            }
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Error storing fingerprints: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    void fetchCoupleRange(const uint32_t* addresses, size_t count, CoupleTable& result) {
+        for (size_t offset = 0; offset < count; offset += lookupChunkSize) {
+            size_t end = std::min(count, offset + lookupChunkSize);
+            try {
+                using namespace bsoncxx::builder::stream;
+                auto entry = acquire();
+                auto collection = (*entry)[database][fingerprintCollection];
+
+                bsoncxx::builder::basic::array ids;
+                for (size_t i = offset; i < end; i++) {
+                    ids.append(static_cast<int64_t>(addresses[i]));
+                }
+                auto filter = document{} << "_id" << open_document
+                                         << "$in" << bsoncxx::types::b_array{ids.view()}
+                                         << close_document << finalize;
+
+                for (auto&& doc : collection.find(filter.view())) {
+                    result.AddAddress(static_cast<uint32_t>(doc["_id"].get_int64().value));
+                    decodeCouples(doc, result);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error retrieving couples for " << (end - offset) << " addresses: " << e.what() << std::endl;
+            }
+        }
+    }
+
     std::string getConnectionUri() {
+        if (baseUri) {
+            std::string options = getPoolOptions();
+            std::string uri = *baseUri;
+            if (uri.find('/', uri.find("://") + 3) == std::string::npos) uri += "/";
+            if (uri.find('?') != std::string::npos && !options.empty()) options[0] = '&';
+            return uri + options;
+        }
+
         // Get environment variables for MongoDB connection
         std::string dbUsername = getEnv("DB_USER", "");
         std::string dbPassword = getEnv("DB_PASS", "");
@@ -280,11 +882,30 @@ private:
         std::string dbPort = getEnv("DB_PORT", "");
         
         if (dbUsername.empty() || dbPassword.empty()) {
-            return "mongodb://localhost:27017";
+            return "mongodb://localhost:27017/" + getPoolOptions();
         }
         
         return "mongodb://" + dbUsername + ":" + dbPassword + "@" + 
-               dbHost + ":" + dbPort + "/" + dbName;
+               dbHost + ":" + dbPort + "/" + dbName + getPoolOptions();
+    }
+
+    // Pool size and timeouts as URI options; unset variables keep the driver defaults
+    std::string getPoolOptions() {
+        const std::vector<std::pair<const char*, const char*>> options = {
+            {"DB_POOL_SIZE", "maxPoolSize"},
+            {"DB_POOL_MIN_SIZE", "minPoolSize"},
+            {"DB_CONNECT_TIMEOUT_MS", "connectTimeoutMS"},
+            {"DB_SOCKET_TIMEOUT_MS", "socketTimeoutMS"},
+            {"DB_SERVER_SELECTION_TIMEOUT_MS", "serverSelectionTimeoutMS"},
+        };
+
+        std::string query;
+        for (const auto& [variable, option] : options) {
+            std::string value = getEnv(variable, "");
+            if (value.empty()) continue;
+            query += (query.empty() ? "?" : "&") + std::string(option) + "=" + value;
+        }
+        return query;
     }
     
     std::string getEnv(const std::string& key, const std::string& defaultValue = "") {
@@ -1,67 +1,161 @@
+#pragma once
 #include <iostream>
 #include <vector>
 #include <tuple>
+#include <string>
+#include <functional>
+#include <cstdint>
 #include <mpg123.h>
+#include <header/decoder.h>
 
-#define BUFFER_SIZE 8192  
-#define TARGET_SAMPLE_RATE 48000
+#define BUFFER_SIZE 8192
 
 
-std::tuple<std::vector<double>, long, int, double> decodeMP3ToFloat(const std::string& mp3FilePath) {
-    std::vector<double> floatSamples;
-    long sampleRate = 0;
-    int channels = 0;
-    double duration = 0.0;
+// mpg123_init/mpg123_exit must run once per process, not once per file
+class MPG123Library {
+public:
+    static void Ensure() {
+        static MPG123Library library;
+    }
 
+private:
+    MPG123Library() { mpg123_init(); }
+    ~MPG123Library() { mpg123_exit(); }
+};
 
-    mpg123_init();
-    mpg123_handle* mh = mpg123_new(NULL, NULL);
-    if (mpg123_open(mh, mp3FilePath.c_str()) != MPG123_OK) {
-        std::cerr << "Error opening MP3 file: " << mp3FilePath << std::endl;
-        return {floatSamples, sampleRate, channels, duration}; 
-    }
 
-    int encoding;
-    
+// Reusable MP3 decoder producing mono samples at the file's rate. The handle
+// is created once and reused for every file opened with it. Decode() hands out
+// blocks as they are decoded so analysis can start before the file is done.
+class MP3Decoder : public AudioDecoder {
+public:
+    MP3Decoder() {
+        MPG123Library::Ensure();
+        mh = mpg123_new(NULL, NULL);
+    }
 
-    mpg123_format_none(mh);
-    mpg123_format(mh, TARGET_SAMPLE_RATE, MPG123_STEREO, MPG123_ENC_SIGNED_16);
+    ~MP3Decoder() override {
+        Close();
+        if (mh) mpg123_delete(mh);
+    }
 
+    MP3Decoder(const MP3Decoder&) = delete;
+    MP3Decoder& operator=(const MP3Decoder&) = delete;
 
-    mpg123_getformat(mh, &sampleRate, &channels, &encoding);
+    bool Open(const std::string& mp3FilePath) override {
+        Close();
+        if (!mh || mpg123_open(mh, mp3FilePath.c_str()) != MPG123_OK) {
+            std::cerr << "Error opening MP3 file: " << mp3FilePath << std::endl;
+            return false;
+        }
+        opened = true;
+
+        // Keep the stream's own rate and only fix the encoding
+        int encoding = 0;
+        if (mpg123_getformat(mh, &sampleRate, &channels, &encoding) != MPG123_OK) {
+            std::cerr << "Error reading MP3 format: " << mp3FilePath << std::endl;
+            Close();
+            return false;
+        }
+        mpg123_format_none(mh);
+        mpg123_format(mh, sampleRate, MPG123_MONO | MPG123_STEREO, MPG123_ENC_SIGNED_16);
+
+        if (mpg123_getformat(mh, &sampleRate, &channels, &encoding) != MPG123_OK ||
+            encoding != MPG123_ENC_SIGNED_16) {
+            std::cerr << "Unsupported encoding format!" << std::endl;
+            Close();
+            return false;
+        }
+        return true;
+    }
 
-    if (encoding != MPG123_ENC_SIGNED_16) {
-        std::cerr << "Unsupported encoding format!" << std::endl;
-        mpg123_close(mh);
-        mpg123_delete(mh);
-        mpg123_exit();
-        return {floatSamples, sampleRate, channels, duration};
+    void Close() override {
+        if (opened) {
+            mpg123_close(mh);
+            opened = false;
+        }
     }
 
-    mpg123_scan(mh);  
-    off_t totalFrames = mpg123_length(mh);
+    long SampleRate() const override { return sampleRate; }
 
-    if (totalFrames > 0 && sampleRate > 0) {
-        duration = static_cast<double>(totalFrames) / static_cast<double>(sampleRate);
+    // Frame count from the stream headers, without the extra mpg123_scan pass.
+    // This is an estimate for VBR files without a Xing/Info header; <= 0 if unknown.
+    long EstimatedLength() const override {
+        return opened ? static_cast<long>(mpg123_length(mh)) : 0;
     }
 
-    std::vector<unsigned char> buffer(BUFFER_SIZE);
-    size_t done;
-
+    bool Decode(const BlockCallback& onBlock) override {
+        if (!opened) return false;
+
+        pcm.resize(BUFFER_SIZE / sizeof(int16_t));
+        mono.resize(pcm.size());
+
+        while (true) {
+            size_t done = 0;
+            int err = mpg123_read(mh, reinterpret_cast<unsigned char*>(pcm.data()), BUFFER_SIZE, &done);
+            if (err == MPG123_NEW_FORMAT) {
+                int encoding = 0;
+                mpg123_getformat(mh, &sampleRate, &channels, &encoding);
+            } else if (err != MPG123_OK && err != MPG123_DONE) {
+                std::cerr << "Error decoding MP3: " << mpg123_strerror(mh) << std::endl;
+                return false;
+            }
+
+            size_t count = toMono(done / sizeof(int16_t));
+            if (count > 0 && !onBlock(mono.data(), count)) {
+                return true;
+            }
+            if (err == MPG123_DONE) {
+                return true;
+            }
+        }
+    }
 
-    while (mpg123_read(mh, buffer.data(), BUFFER_SIZE, &done) == MPG123_OK) {
-        for (size_t i = 0; i < done; i += 2) { 
-            int16_t sample = buffer[i] | (buffer[i + 1] << 8);
-            floatSamples.push_back(sample / 32768.0); 
+private:
+    mpg123_handle* mh = nullptr;
+    bool opened = false;
+    long sampleRate = 0;
+    int channels = 0;
+    std::vector<int16_t> pcm;
+    std::vector<double> mono;
+
+    // Downmixes interleaved int16 into `mono`; plain loops so they vectorize
+    size_t toMono(size_t values) {
+        const int16_t* in = pcm.data();
+        double* out = mono.data();
+        if (channels == 2) {
+            size_t frames = values / 2;
+            for (size_t i = 0; i < frames; i++) {
+                out[i] = (in[2 * i] + in[2 * i + 1]) * (1.0 / 65536.0);
+            }
+            return frames;
+        }
+        for (size_t i = 0; i < values; i++) {
+            out[i] = in[i] * (1.0 / 32768.0);
         }
+        return values;
     }
+};
 
 
-    mpg123_close(mh);
-    mpg123_delete(mh);
-    mpg123_exit();
+// Decodes the whole file. Samples are mono, so the channel count is always 1.
+inline std::tuple<std::vector<double>, long, int, double> decodeMP3ToFloat(const std::string& mp3FilePath) {
+    std::vector<double> floatSamples;
+    long sampleRate = 0;
+    int channels = 1;
+    double duration = 0.0;
+
+    MP3Decoder decoder;
+    if (!decoder.Open(mp3FilePath) || !decoder.DecodeAll(floatSamples)) {
+        return {std::vector<double>(), sampleRate, channels, duration};
+    }
+
+    sampleRate = decoder.SampleRate();
+    if (sampleRate > 0) {
+        duration = static_cast<double>(floatSamples.size()) / static_cast<double>(sampleRate);
+    }
 
-    return {floatSamples, sampleRate, channels, duration};
+    return {std::move(floatSamples), sampleRate, channels, duration};
 }
 
 // // Main function to test MP3 decoding
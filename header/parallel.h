@@ -0,0 +1,173 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+// Fixed set of worker threads shared by the DSP stages. Run() splits a job
+// into numbered tasks that the workers and the calling thread claim one at a
+// time, and returns once all of them have finished. Several threads may run
+// jobs at once; a Run() from inside a task runs inline, so nested loops
+// cannot deadlock the pool. The first exception a task throws is rethrown
+// by Run(). Jobs live on the caller's stack, so Run() does not allocate.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workers) {
+        jobs.reserve(64);
+        for (size_t i = 0; i < workers; i++) {
+            threads.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads that work on a job: the workers plus the caller
+    size_t Concurrency() const { return threads.size() + 1; }
+
+    // fn(task) for every task in [0, tasks)
+    template <typename F>
+    void Run(size_t tasks, F&& fn) {
+        if (tasks == 0) return;
+        if (tasks == 1 || threads.empty() || insideTask) {
+            for (size_t i = 0; i < tasks; i++) fn(i);
+            return;
+        }
+
+        using Fn = std::remove_reference_t<F>;
+        void* context = const_cast<void*>(static_cast<const void*>(&fn));
+        Job job(tasks, context, [](void* context, size_t task) { (*static_cast<Fn*>(context))(task); });
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(&job);
+        }
+        wake.notify_all();
+
+        work(job);
+        {
+            // No worker can pick the job up after this; wait for those that did
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = std::find(jobs.begin(), jobs.end(), &job);
+            if (it != jobs.end()) jobs.erase(it);
+        }
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.finished.wait(lock, [&]() { return job.remaining.load() == 0 && job.users == 0; });
+        }
+        if (job.error) std::rethrow_exception(job.error);
+    }
+
+private:
+    struct Job {
+        Job(size_t tasks, void* context, void (*call)(void*, size_t))
+            : tasks(tasks), context(context), call(call), remaining(tasks) {}
+
+        size_t tasks;
+        void* context;
+        void (*call)(void* context, size_t task);
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> remaining;
+        size_t users = 0;  // Workers inside work(), guarded by mutex
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<Job*> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static inline thread_local bool insideTask = false;
+
+    static void work(Job& job) {
+        bool outer = insideTask;
+        insideTask = true;
+        for (size_t task = job.next++; task < job.tasks; task = job.next++) {
+            try {
+                job.call(job.context, task);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (!job.error) job.error = std::current_exception();
+            }
+            if (--job.remaining == 0) {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.finished.notify_all();
+            }
+        }
+        insideTask = outer;
+    }
+
+    void workerLoop() {
+        while (true) {
+            Job* job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = jobs.front();
+                // Every task of the front job is claimed; move on to the next
+                if (job->next.load() >= job->tasks) {
+                    jobs.erase(jobs.begin());
+                    continue;
+                }
+                std::lock_guard<std::mutex> jobLock(job->mutex);
+                job->users++;
+            }
+            work(*job);
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            job->users--;
+            job->finished.notify_all();
+        }
+    }
+};
+
+
+// Pool used by Spectrogram, ExtractPeaks and FingerprintPipeline. DSP_THREADS
+// sets the number of threads working on one track (default: one per core);
+// DSP_THREADS=1 keeps all DSP work on the calling thread.
+inline ThreadPool& DspThreadPool() {
+    static ThreadPool pool([]() {
+        const char* value = std::getenv("DSP_THREADS");
+        long threads = value ? std::atol(value) : static_cast<long>(std::thread::hardware_concurrency());
+        return static_cast<size_t>(std::max(1L, threads) - 1);
+    }());
+    return pool;
+}
+
+
+// Calls fn(begin, end) on contiguous chunks of [0, count), in parallel on the
+// DSP pool. Chunks are at least minChunk long, and there are a few per thread
+// so uneven chunks even out. Each index is visited exactly once; results
+// written per index come out in order.
+template <typename F>
+inline void ParallelFor(size_t count, size_t minChunk, F&& fn) {
+    if (count == 0) return;
+    ThreadPool& pool = DspThreadPool();
+    size_t chunks = std::min(pool.Concurrency() * 4, std::max<size_t>(1, count / std::max<size_t>(1, minChunk)));
+    size_t chunkSize = (count + chunks - 1) / chunks;
+    chunks = (count + chunkSize - 1) / chunkSize;
+
+    pool.Run(chunks, [&](size_t chunk) {
+        size_t begin = chunk * chunkSize;
+        fn(begin, std::min(count, begin + chunkSize));
+    });
+}
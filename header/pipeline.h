@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <variant>
+#include <header/spectogram.h>
+#include <header/fingerprint.h>
+#include <header/workspace.h>
+
+
+// Incremental Spectrogram -> ExtractPeaks -> Fingerprint. Samples can be pushed
+// in blocks of any size. Frames are analysed FRAME_BATCH at a time in parallel
+// on the DSP pool, and their peaks and fingerprint couples are handed to the
+// sinks in frame order once final. Memory is bounded by one batch of frames,
+// the resampler history and TargetZoneSize pending peaks, whatever the track
+// length. Feeding a whole signal produces the same peaks as the batch functions
+// instantiated on the same Config.
+//
+// Buffers come from a DspWorkspace. Pass one that is reused across tracks to
+// keep the pipeline from allocating once the workspace has warmed up; without
+// one the pipeline makes its own.
+template <typename Config>
+class BasicFingerprintPipeline {
+public:
+    using PeakSink = std::function<void(const Peak&)>;
+    using HashSink = std::function<void(const FingerprintHash& hash)>;
+
+    BasicFingerprintPipeline(int sampleRate, HashSink onHash, PeakSink onPeak = nullptr,
+                             DspWorkspace* workspace = nullptr)
+        : onHash(std::move(onHash)), onPeak(std::move(onPeak)),
+          ownedWorkspace(workspace ? nullptr : std::make_unique<DspWorkspace>()),
+          ws(workspace ? *workspace : *ownedWorkspace),
+          resampler(ws.Resampler(sampleRate, Config::AnalysisRate, Config::MaxFreq)),
+          rows(ws.Rows(FRAME_BATCH, Config::PeakBins, Config::HopSize / static_cast<double>(Config::AnalysisRate))) {
+        ws.Reset();
+        if (ws.framePeaks.size() < FRAME_BATCH) {
+            ws.framePeaks.resize(FRAME_BATCH);
+        }
+    }
+
+    void Push(const double* samples, size_t count) {
+        while (count > 0) {
+            size_t n = std::min(count, BLOCK_SIZE);
+            ws.resampled.clear();
+            resampler.Process(samples, n, ws.resampled);
+            ws.samples.insert(ws.samples.end(), ws.resampled.begin(), ws.resampled.end());
+            while (readyFrames() >= FRAME_BATCH) {
+                analyzeFrames(FRAME_BATCH);
+            }
+            samples += n;
+            count -= n;
+        }
+    }
+
+    void Push(const std::vector<double>& samples) {
+        Push(samples.data(), samples.size());
+    }
+
+    // Flushes the resampler tail and the anchors whose target zone runs past
+    // the end of the track
+    void Finish() {
+        ws.resampled.clear();
+        resampler.Flush(ws.resampled);
+        ws.samples.insert(ws.samples.end(), ws.resampled.begin(), ws.resampled.end());
+        while (size_t frames = readyFrames()) {
+            analyzeFrames(std::min(frames, FRAME_BATCH));
+        }
+        while (!ws.pending.empty()) {
+            emitAnchor();
+        }
+    }
+
+    size_t Frames() const { return frameIdx; }
+    size_t Peaks() const { return peakCount; }
+    size_t Couples() const { return coupleCount; }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static constexpr size_t FRAME_BATCH = 256;
+
+    HashSink onHash;
+    PeakSink onPeak;
+
+    std::unique_ptr<DspWorkspace> ownedWorkspace;
+    DspWorkspace& ws;
+    PolyphaseResampler& resampler;
+
+    // ws.samples starts at sample samplesStart; frame k starts at k * HopSize
+    size_t samplesStart = 0;
+    size_t frameIdx = 0;
+    SpectrogramBuffer& rows;
+
+    size_t peakCount = 0;
+    size_t coupleCount = 0;
+
+    // Frames from frameIdx on whose window is complete
+    size_t readyFrames() const {
+        size_t end = samplesStart + ws.samples.size();
+        size_t next = frameIdx * Config::HopSize;
+        return end >= next + Config::FrameSize ? (end - next - Config::FrameSize) / Config::HopSize + 1 : 0;
+    }
+
+    void analyzeFrames(size_t count) {
+        ParallelFor(count, MIN_FRAMES_PER_TASK, [&](size_t begin, size_t end) {
+            FrameAnalyzer<Config>& analyzer = ThreadFrameAnalyzer<Config>();
+            for (size_t i = begin; i < end; ++i) {
+                const double* start = ws.samples.data() + (frameIdx + i) * Config::HopSize - samplesStart;
+                analyzer.Analyze(start, Config::FrameSize, nullptr, 0, rows.Magnitudes(i));
+                ws.framePeaks[i].clear();
+                ExtractFramePeaks<Config>(rows[i], frameIdx + i, ws.framePeaks[i]);
+            }
+        });
+
+        for (size_t i = 0; i < count; ++i) {
+            for (const Peak& peak : ws.framePeaks[i]) {
+                if (onPeak) onPeak(peak);
+                ws.pending.push_back(peak);
+                peakCount++;
+                // The oldest anchor is final once its whole target zone is known
+                if (ws.pending.size() > static_cast<size_t>(Config::TargetZoneSize)) {
+                    emitAnchor();
+                }
+            }
+        }
+        frameIdx += count;
+
+        // Samples before the next frame are no longer needed
+        size_t consumed = std::min(frameIdx * Config::HopSize - samplesStart, ws.samples.size());
+        ws.samples.erase(ws.samples.begin(), ws.samples.begin() + consumed);
+        samplesStart += consumed;
+    }
+
+    void emitAnchor() {
+        const Peak& anchor = ws.pending.front();
+        uint32_t anchorTimeMs = PeakTimeMs<Config>(anchor);
+        for (size_t j = 1; j < ws.pending.size() && j <= static_cast<size_t>(Config::TargetZoneSize); ++j) {
+            onHash(FingerprintHash{createAddress<Config>(anchor, ws.pending[j]), anchorTimeMs});
+            coupleCount++;
+        }
+        ws.pending.erase(ws.pending.begin());
+    }
+};
+
+
+// The pipeline of the preset chosen at runtime (FINGERPRINT_PRESET unless
+// given). Every preset is instantiated; the choice is made once per track and
+// the per-frame work runs in the instantiation for that preset.
+class FingerprintPipeline {
+public:
+    using PeakSink = std::function<void(const Peak&)>;
+    using HashSink = std::function<void(const FingerprintHash& hash)>;
+
+    FingerprintPipeline(int sampleRate, HashSink onHash, PeakSink onPeak = nullptr,
+                        DspWorkspace* workspace = nullptr, FingerprintPreset preset = ActiveFingerprintPreset())
+        : pipeline(WithFingerprintConfig(preset, [&](auto config) {
+              using Config = decltype(config);
+              return Variant(std::in_place_type<BasicFingerprintPipeline<Config>>, sampleRate,
+                             std::move(onHash), std::move(onPeak), workspace);
+          })) {}
+
+    void Push(const double* samples, size_t count) {
+        std::visit([&](auto& p) { p.Push(samples, count); }, pipeline);
+    }
+
+    void Push(const std::vector<double>& samples) {
+        Push(samples.data(), samples.size());
+    }
+
+    void Finish() {
+        std::visit([](auto& p) { p.Finish(); }, pipeline);
+    }
+
+    size_t Frames() const { return std::visit([](const auto& p) { return p.Frames(); }, pipeline); }
+    size_t Peaks() const { return std::visit([](const auto& p) { return p.Peaks(); }, pipeline); }
+    size_t Couples() const { return std::visit([](const auto& p) { return p.Couples(); }, pipeline); }
+
+private:
+    using Variant = std::variant<BasicFingerprintPipeline<BalancedFingerprintConfig>,
+                                 BasicFingerprintPipeline<FastFingerprintConfig>,
+                                 BasicFingerprintPipeline<AccurateFingerprintConfig>>;
+    Variant pipeline;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <cstddef>
+
+
+// Multi-producer/multi-consumer FIFO with a fixed capacity. Push blocks while
+// the queue is full, so a fast stage cannot run arbitrarily far ahead of a slow
+// one. After Close(), Push fails and Pop drains what is left, then returns nullopt.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [&] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    std::optional<T> Pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [&] { return closed || !items.empty(); });
+        if (items.empty()) return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
@@ -0,0 +1,168 @@
+#ifndef SHARDED_DB_CLIENT_H
+#define SHARDED_DB_CLIENT_H
+
+#include <header/client.h>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// DBClient that spreads the fingerprint table over several underlying clients
+// (Mongo instances, in-memory or index file backends) by address: shard i owns
+// the i-th of N equal slices of the range of MixAddress, so every address
+// layout spreads evenly. Fingerprint
+// writes and lookups are split per shard and run on all shards in parallel;
+// lookup results are concatenated. Songs are small and live on shard 0, which
+// also hands out song IDs. The shards must be thread-safe.
+class ShardedClient : public DBClient {
+public:
+    explicit ShardedClient(std::vector<std::unique_ptr<DBClient>> shards) : shards(std::move(shards)) {
+        if (this->shards.empty()) {
+            throw std::invalid_argument("ShardedClient needs at least one shard");
+        }
+    }
+
+    static size_t ShardOf(uint32_t address, size_t shardCount) {
+        return static_cast<size_t>((static_cast<uint64_t>(MixAddress(address)) * shardCount) >> 32);
+    }
+
+    size_t Shards() const { return shards.size(); }
+    DBClient& Shard(size_t i) { return *shards[i]; }
+
+    bool Connect() override {
+        bool connected = true;
+        for (auto& shard : shards) {
+            connected = shard->Connect() && connected;
+        }
+        return connected;
+    }
+
+    void Disconnect() override {
+        for (auto& shard : shards) {
+            shard->Disconnect();
+        }
+    }
+
+    bool IsConnected() const override {
+        for (const auto& shard : shards) {
+            if (!shard->IsConnected()) return false;
+        }
+        return true;
+    }
+
+    bool StoreFingerprints(uint32_t songID, const std::vector<FingerprintHash>& fingerprints) override {
+        std::vector<std::vector<FingerprintHash>> parts(shards.size());
+        for (const FingerprintHash& hash : fingerprints) {
+            parts[ShardOf(hash.address, shards.size())].push_back(hash);
+        }
+
+        std::vector<std::future<bool>> pending;
+        for (size_t i = 0; i < shards.size(); i++) {
+            if (parts[i].empty()) continue;
+            pending.push_back(std::async(std::launch::async, [this, i, songID, &parts]() {
+                return shards[i]->StoreFingerprints(songID, parts[i]);
+            }));
+        }
+
+        bool success = true;
+        for (auto& result : pending) {
+            success = result.get() && success;
+        }
+        return success;
+    }
+
+    CoupleTable GetCouples(const std::vector<uint32_t>& addresses) override {
+        std::vector<std::vector<uint32_t>> parts(shards.size());
+        for (uint32_t address : addresses) {
+            parts[ShardOf(address, shards.size())].push_back(address);
+        }
+
+        std::vector<std::future<CoupleTable>> pending;
+        for (size_t i = 0; i < shards.size(); i++) {
+            if (parts[i].empty()) continue;
+            pending.push_back(std::async(std::launch::async, [this, i, &parts]() {
+                return shards[i]->GetCouples(parts[i]);
+            }));
+        }
+
+        CoupleTable result;
+        for (auto& part : pending) {
+            result.Append(part.get());
+        }
+        return result;
+    }
+
+    int TotalSongs() override {
+        return shards[0]->TotalSongs();
+    }
+
+    uint32_t RegisterSong(const std::string& songTitle, const std::string& songArtist) override {
+        return shards[0]->RegisterSong(songTitle, songArtist);
+    }
+
+    std::optional<Song> GetSong(const std::string& filterKey, const std::string& value) override {
+        return shards[0]->GetSong(filterKey, value);
+    }
+
+    std::optional<Song> GetSongByID(uint32_t songID) override {
+        return shards[0]->GetSongByID(songID);
+    }
+
+    std::optional<Song> GetSongByKey(const std::string& key) override {
+        return shards[0]->GetSongByKey(key);
+    }
+
+    std::vector<std::optional<Song>> GetSongsByIDs(const std::vector<uint32_t>& songIDs) override {
+        return shards[0]->GetSongsByIDs(songIDs);
+    }
+
+    bool ExportSongs(const std::function<void(uint32_t songID, const Song& song)>& onSong) override {
+        return shards[0]->ExportSongs(onSong);
+    }
+
+    // The song's fingerprints stay behind, as with a single backend
+    bool DeleteSongByID(uint32_t songID) override {
+        return shards[0]->DeleteSongByID(songID);
+    }
+
+    bool DeleteFingerprints(uint32_t songID, const std::vector<uint32_t>& addresses) override {
+        std::vector<std::vector<uint32_t>> parts(shards.size());
+        for (uint32_t address : addresses) {
+            parts[ShardOf(address, shards.size())].push_back(address);
+        }
+
+        bool success = true;
+        for (size_t i = 0; i < shards.size(); i++) {
+            if (!parts[i].empty()) success = shards[i]->DeleteFingerprints(songID, parts[i]) && success;
+        }
+        return success;
+    }
+
+    bool DeleteCollection(const std::string& collectionName) override {
+        if (collectionName == "songs") {
+            return shards[0]->DeleteCollection(collectionName);
+        }
+        bool success = true;
+        for (auto& shard : shards) {
+            success = shard->DeleteCollection(collectionName) && success;
+        }
+        return success;
+    }
+
+    std::map<std::string, double> Metrics() override {
+        std::map<std::string, double> metrics;
+        for (size_t i = 0; i < shards.size(); i++) {
+            for (const auto& [name, value] : shards[i]->Metrics()) {
+                metrics["shard" + std::to_string(i) + "." + name] = value;
+            }
+        }
+        return metrics;
+    }
+
+private:
+    std::vector<std::unique_ptr<DBClient>> shards;
+};
+
+#endif
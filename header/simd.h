@@ -0,0 +1,452 @@
+#pragma once
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SHAZAM_SIMD_X86 1
+#include <immintrin.h>
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SHAZAM_SIMD_X86 0
+#endif
+
+
+// Vector kernels used by the FFT, the resampler and the spectrogram, one table
+// per sample type. The table is picked once at startup from CPUID so a single
+// binary uses the widest instruction set available on the machine it runs on.
+template <typename T>
+struct SimdKernels {
+    const char* name;
+    // One radix-2 stage over n values with half-size h and twiddles w[0, h)
+    void (*butterfly)(std::complex<T>* data, const std::complex<T>* w, size_t n, size_t h);
+    // out[i] = in[i] * window[i]
+    void (*multiply)(T* out, const T* in, const T* window, size_t n);
+    // out[i] = |in[i]|^2
+    void (*squaredMagnitude)(T* out, const std::complex<T>* in, size_t n);
+    // sum of a[i] * b[i]
+    T (*dot)(const T* a, const T* b, size_t n);
+};
+
+
+namespace simd {
+
+// Scalar reference kernels, also used for the tails the vector kernels leave over
+
+template <typename T>
+inline void butterflyScalar(std::complex<T>* data, const std::complex<T>* w, size_t n, size_t h) {
+    for (size_t start = 0; start < n; start += 2 * h) {
+        for (size_t k = 0; k < h; k++) {
+            const T wr = w[k].real(), wi = w[k].imag();
+            const T xr = data[start + k + h].real(), xi = data[start + k + h].imag();
+            const std::complex<T> t(wr * xr - wi * xi, wr * xi + wi * xr);
+            data[start + k + h] = data[start + k] - t;
+            data[start + k] += t;
+        }
+    }
+}
+
+template <typename T>
+inline void multiplyScalar(T* out, const T* in, const T* window, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = in[i] * window[i];
+    }
+}
+
+template <typename T>
+inline void squaredMagnitudeScalar(T* out, const std::complex<T>* in, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = in[i].real() * in[i].real() + in[i].imag() * in[i].imag();
+    }
+}
+
+template <typename T>
+inline T dotScalar(const T* a, const T* b, size_t n) {
+    T sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if SHAZAM_SIMD_X86
+
+// ---------- SSE2 ----------
+
+SIMD_TARGET("sse2") inline __m128d cmulSse2(__m128d a, __m128d b) {
+    __m128d br = _mm_unpacklo_pd(b, b);
+    __m128d bi = _mm_unpackhi_pd(b, b);
+    __m128d as = _mm_shuffle_pd(a, a, 1);
+    __m128d t = _mm_xor_pd(_mm_mul_pd(as, bi), _mm_set_pd(0.0, -0.0));
+    return _mm_add_pd(_mm_mul_pd(a, br), t);
+}
+
+SIMD_TARGET("sse2") inline __m128 cmulSse2(__m128 a, __m128 b) {
+    __m128 br = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 bi = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+    __m128 as = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 t = _mm_xor_ps(_mm_mul_ps(as, bi), _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f));
+    return _mm_add_ps(_mm_mul_ps(a, br), t);
+}
+
+SIMD_TARGET("sse2") inline void butterflySse2(std::complex<double>* data, const std::complex<double>* w, size_t n, size_t h) {
+    double* d = reinterpret_cast<double*>(data);
+    const double* tw = reinterpret_cast<const double*>(w);
+    for (size_t start = 0; start < n; start += 2 * h) {
+        double* lo = d + 2 * start;
+        double* hi = lo + 2 * h;
+        for (size_t k = 0; k < h; k++) {
+            __m128d t = cmulSse2(_mm_loadu_pd(hi + 2 * k), _mm_loadu_pd(tw + 2 * k));
+            __m128d x = _mm_loadu_pd(lo + 2 * k);
+            _mm_storeu_pd(hi + 2 * k, _mm_sub_pd(x, t));
+            _mm_storeu_pd(lo + 2 * k, _mm_add_pd(x, t));
+        }
+    }
+}
+
+SIMD_TARGET("sse2") inline void butterflySse2(std::complex<float>* data, const std::complex<float>* w, size_t n, size_t h) {
+    if (h < 2) return butterflyScalar(data, w, n, h);
+    float* d = reinterpret_cast<float*>(data);
+    const float* tw = reinterpret_cast<const float*>(w);
+    for (size_t start = 0; start < n; start += 2 * h) {
+        float* lo = d + 2 * start;
+        float* hi = lo + 2 * h;
+        for (size_t k = 0; k < h; k += 2) {
+            __m128 t = cmulSse2(_mm_loadu_ps(hi + 2 * k), _mm_loadu_ps(tw + 2 * k));
+            __m128 x = _mm_loadu_ps(lo + 2 * k);
+            _mm_storeu_ps(hi + 2 * k, _mm_sub_ps(x, t));
+            _mm_storeu_ps(lo + 2 * k, _mm_add_ps(x, t));
+        }
+    }
+}
+
+SIMD_TARGET("sse2") inline void multiplySse2(double* out, const double* in, const double* window, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(in + i), _mm_loadu_pd(window + i)));
+    }
+    multiplyScalar(out + i, in + i, window + i, n - i);
+}
+
+SIMD_TARGET("sse2") inline void multiplySse2(float* out, const float* in, const float* window, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(window + i)));
+    }
+    multiplyScalar(out + i, in + i, window + i, n - i);
+}
+
+SIMD_TARGET("sse2") inline void squaredMagnitudeSse2(double* out, const std::complex<double>* in, size_t n) {
+    const double* s = reinterpret_cast<const double*>(in);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d a = _mm_loadu_pd(s + 2 * i);
+        __m128d b = _mm_loadu_pd(s + 2 * i + 2);
+        a = _mm_mul_pd(a, a);
+        b = _mm_mul_pd(b, b);
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b)));
+    }
+    squaredMagnitudeScalar(out + i, in + i, n - i);
+}
+
+SIMD_TARGET("sse2") inline void squaredMagnitudeSse2(float* out, const std::complex<float>* in, size_t n) {
+    const float* s = reinterpret_cast<const float*>(in);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(s + 2 * i);
+        __m128 b = _mm_loadu_ps(s + 2 * i + 4);
+        a = _mm_mul_ps(a, a);
+        b = _mm_mul_ps(b, b);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(out + i, _mm_add_ps(re, im));
+    }
+    squaredMagnitudeScalar(out + i, in + i, n - i);
+}
+
+SIMD_TARGET("sse2") inline double dotSse2(const double* a, const double* b, size_t n) {
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    __m128d acc = _mm_add_pd(acc0, acc1);
+    acc = _mm_add_sd(acc, _mm_unpackhi_pd(acc, acc));
+    return _mm_cvtsd_f64(acc) + dotScalar(a + i, b + i, n - i);
+}
+
+SIMD_TARGET("sse2") inline float dotSse2(const float* a, const float* b, size_t n) {
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return _mm_cvtss_f32(acc) + dotScalar(a + i, b + i, n - i);
+}
+
+// ---------- AVX2 ----------
+
+SIMD_TARGET("avx2,fma") inline __m256d cmulAvx2(__m256d a, __m256d b) {
+    __m256d br = _mm256_movedup_pd(b);
+    __m256d bi = _mm256_permute_pd(b, 0xF);
+    __m256d as = _mm256_permute_pd(a, 0x5);
+    return _mm256_fmaddsub_pd(a, br, _mm256_mul_pd(as, bi));
+}
+
+SIMD_TARGET("avx2,fma") inline __m256 cmulAvx2(__m256 a, __m256 b) {
+    __m256 br = _mm256_moveldup_ps(b);
+    __m256 bi = _mm256_movehdup_ps(b);
+    __m256 as = _mm256_permute_ps(a, 0xB1);
+    return _mm256_fmaddsub_ps(a, br, _mm256_mul_ps(as, bi));
+}
+
+SIMD_TARGET("avx2,fma") inline void butterflyAvx2(std::complex<double>* data, const std::complex<double>* w, size_t n, size_t h) {
+    if (h < 2) return butterflySse2(data, w, n, h);
+    double* d = reinterpret_cast<double*>(data);
+    const double* tw = reinterpret_cast<const double*>(w);
+    for (size_t start = 0; start < n; start += 2 * h) {
+        double* lo = d + 2 * start;
+        double* hi = lo + 2 * h;
+        for (size_t k = 0; k < h; k += 2) {
+            __m256d t = cmulAvx2(_mm256_loadu_pd(hi + 2 * k), _mm256_loadu_pd(tw + 2 * k));
+            __m256d x = _mm256_loadu_pd(lo + 2 * k);
+            _mm256_storeu_pd(hi + 2 * k, _mm256_sub_pd(x, t));
+            _mm256_storeu_pd(lo + 2 * k, _mm256_add_pd(x, t));
+        }
+    }
+}
+
+SIMD_TARGET("avx2,fma") inline void butterflyAvx2(std::complex<float>* data, const std::complex<float>* w, size_t n, size_t h) {
+    if (h < 4) return butterflySse2(data, w, n, h);
+    float* d = reinterpret_cast<float*>(data);
+    const float* tw = reinterpret_cast<const float*>(w);
+    for (size_t start = 0; start < n; start += 2 * h) {
+        float* lo = d + 2 * start;
+        float* hi = lo + 2 * h;
+        for (size_t k = 0; k < h; k += 4) {
+            __m256 t = cmulAvx2(_mm256_loadu_ps(hi + 2 * k), _mm256_loadu_ps(tw + 2 * k));
+            __m256 x = _mm256_loadu_ps(lo + 2 * k);
+            _mm256_storeu_ps(hi + 2 * k, _mm256_sub_ps(x, t));
+            _mm256_storeu_ps(lo + 2 * k, _mm256_add_ps(x, t));
+        }
+    }
+}
+
+SIMD_TARGET("avx2,fma") inline void multiplyAvx2(double* out, const double* in, const double* window, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(in + i), _mm256_loadu_pd(window + i)));
+    }
+    multiplyScalar(out + i, in + i, window + i, n - i);
+}
+
+SIMD_TARGET("avx2,fma") inline void multiplyAvx2(float* out, const float* in, const float* window, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_loadu_ps(window + i)));
+    }
+    multiplyScalar(out + i, in + i, window + i, n - i);
+}
+
+SIMD_TARGET("avx2,fma") inline void squaredMagnitudeAvx2(double* out, const std::complex<double>* in, size_t n) {
+    const double* s = reinterpret_cast<const double*>(in);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d a = _mm256_loadu_pd(s + 2 * i);
+        __m256d b = _mm256_loadu_pd(s + 2 * i + 4);
+        __m256d sum = _mm256_hadd_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b));
+        _mm256_storeu_pd(out + i, _mm256_permute4x64_pd(sum, 0xD8));
+    }
+    squaredMagnitudeScalar(out + i, in + i, n - i);
+}
+
+SIMD_TARGET("avx2,fma") inline void squaredMagnitudeAvx2(float* out, const std::complex<float>* in, size_t n) {
+    const float* s = reinterpret_cast<const float*>(in);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(s + 2 * i);
+        __m256 b = _mm256_loadu_ps(s + 2 * i + 8);
+        __m256 sum = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+        __m256d ordered = _mm256_permute4x64_pd(_mm256_castps_pd(sum), 0xD8);
+        _mm256_storeu_ps(out + i, _mm256_castpd_ps(ordered));
+    }
+    squaredMagnitudeScalar(out + i, in + i, n - i);
+}
+
+SIMD_TARGET("avx2,fma") inline double dotAvx2(const double* a, const double* b, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+        acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), acc1);
+    }
+    __m256d acc = _mm256_add_pd(acc0, acc1);
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    half = _mm_add_sd(half, _mm_unpackhi_pd(half, half));
+    return _mm_cvtsd_f64(half) + dotScalar(a + i, b + i, n - i);
+}
+
+SIMD_TARGET("avx2,fma") inline float dotAvx2(const float* a, const float* b, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half) + dotScalar(a + i, b + i, n - i);
+}
+
+// ---------- AVX-512 ----------
+
+SIMD_TARGET("avx512f") inline __m512d cmulAvx512(__m512d a, __m512d b) {
+    __m512d br = _mm512_movedup_pd(b);
+    __m512d bi = _mm512_permute_pd(b, 0xFF);
+    __m512d as = _mm512_permute_pd(a, 0x55);
+    return _mm512_fmaddsub_pd(a, br, _mm512_mul_pd(as, bi));
+}
+
+SIMD_TARGET("avx512f") inline __m512 cmulAvx512(__m512 a, __m512 b) {
+    __m512 br = _mm512_moveldup_ps(b);
+    __m512 bi = _mm512_movehdup_ps(b);
+    __m512 as = _mm512_permute_ps(a, 0xB1);
+    return _mm512_fmaddsub_ps(a, br, _mm512_mul_ps(as, bi));
+}
+
+SIMD_TARGET("avx512f,avx2,fma") inline void butterflyAvx512(std::complex<double>* data, const std::complex<double>* w, size_t n, size_t h) {
+    if (h < 4) return butterflyAvx2(data, w, n, h);
+    double* d = reinterpret_cast<double*>(data);
+    const double* tw = reinterpret_cast<const double*>(w);
+    for (size_t start = 0; start < n; start += 2 * h) {
+        double* lo = d + 2 * start;
+        double* hi = lo + 2 * h;
+        for (size_t k = 0; k < h; k += 4) {
+            __m512d t = cmulAvx512(_mm512_loadu_pd(hi + 2 * k), _mm512_loadu_pd(tw + 2 * k));
+            __m512d x = _mm512_loadu_pd(lo + 2 * k);
+            _mm512_storeu_pd(hi + 2 * k, _mm512_sub_pd(x, t));
+            _mm512_storeu_pd(lo + 2 * k, _mm512_add_pd(x, t));
+        }
+    }
+}
+
+SIMD_TARGET("avx512f,avx2,fma") inline void butterflyAvx512(std::complex<float>* data, const std::complex<float>* w, size_t n, size_t h) {
+    if (h < 8) return butterflyAvx2(data, w, n, h);
+    float* d = reinterpret_cast<float*>(data);
+    const float* tw = reinterpret_cast<const float*>(w);
+    for (size_t start = 0; start < n; start += 2 * h) {
+        float* lo = d + 2 * start;
+        float* hi = lo + 2 * h;
+        for (size_t k = 0; k < h; k += 8) {
+            __m512 t = cmulAvx512(_mm512_loadu_ps(hi + 2 * k), _mm512_loadu_ps(tw + 2 * k));
+            __m512 x = _mm512_loadu_ps(lo + 2 * k);
+            _mm512_storeu_ps(hi + 2 * k, _mm512_sub_ps(x, t));
+            _mm512_storeu_ps(lo + 2 * k, _mm512_add_ps(x, t));
+        }
+    }
+}
+
+SIMD_TARGET("avx512f") inline void multiplyAvx512(double* out, const double* in, const double* window, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_loadu_pd(in + i), _mm512_loadu_pd(window + i)));
+    }
+    multiplyScalar(out + i, in + i, window + i, n - i);
+}
+
+SIMD_TARGET("avx512f") inline void multiplyAvx512(float* out, const float* in, const float* window, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(in + i), _mm512_loadu_ps(window + i)));
+    }
+    multiplyScalar(out + i, in + i, window + i, n - i);
+}
+
+SIMD_TARGET("avx512f") inline void squaredMagnitudeAvx512(double* out, const std::complex<double>* in, size_t n) {
+    const double* s = reinterpret_cast<const double*>(in);
+    const __m512i even = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d a = _mm512_loadu_pd(s + 2 * i);
+        __m512d b = _mm512_loadu_pd(s + 2 * i + 8);
+        a = _mm512_mul_pd(a, a);
+        b = _mm512_mul_pd(b, b);
+        a = _mm512_add_pd(a, _mm512_permute_pd(a, 0x55));
+        b = _mm512_add_pd(b, _mm512_permute_pd(b, 0x55));
+        _mm512_storeu_pd(out + i, _mm512_permutex2var_pd(a, even, b));
+    }
+    squaredMagnitudeScalar(out + i, in + i, n - i);
+}
+
+SIMD_TARGET("avx512f") inline void squaredMagnitudeAvx512(float* out, const std::complex<float>* in, size_t n) {
+    const float* s = reinterpret_cast<const float*>(in);
+    const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 a = _mm512_loadu_ps(s + 2 * i);
+        __m512 b = _mm512_loadu_ps(s + 2 * i + 16);
+        a = _mm512_mul_ps(a, a);
+        b = _mm512_mul_ps(b, b);
+        a = _mm512_add_ps(a, _mm512_permute_ps(a, 0xB1));
+        b = _mm512_add_ps(b, _mm512_permute_ps(b, 0xB1));
+        _mm512_storeu_ps(out + i, _mm512_permutex2var_ps(a, even, b));
+    }
+    squaredMagnitudeScalar(out + i, in + i, n - i);
+}
+
+SIMD_TARGET("avx512f") inline double dotAvx512(const double* a, const double* b, size_t n) {
+    __m512d acc = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), acc);
+    }
+    __m256d quarter = _mm256_add_pd(_mm512_castpd512_pd256(acc), _mm512_extractf64x4_pd(acc, 1));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(quarter), _mm256_extractf128_pd(quarter, 1));
+    half = _mm_add_sd(half, _mm_unpackhi_pd(half, half));
+    return _mm_cvtsd_f64(half) + dotScalar(a + i, b + i, n - i);
+}
+
+SIMD_TARGET("avx512f") inline float dotAvx512(const float* a, const float* b, size_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc);
+    }
+    __m256 upper = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1));
+    __m256 quarter = _mm256_add_ps(_mm512_castps512_ps256(acc), upper);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(quarter), _mm256_extractf128_ps(quarter, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half) + dotScalar(a + i, b + i, n - i);
+}
+
+#endif
+
+template <typename T>
+inline SimdKernels<T> selectKernels() {
+#if SHAZAM_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {"avx512", butterflyAvx512, multiplyAvx512, squaredMagnitudeAvx512, dotAvx512};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {"avx2", butterflyAvx2, multiplyAvx2, squaredMagnitudeAvx2, dotAvx2};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {"sse2", butterflySse2, multiplySse2, squaredMagnitudeSse2, dotSse2};
+    }
+#endif
+    return {"scalar", butterflyScalar<T>, multiplyScalar<T>, squaredMagnitudeScalar<T>, dotScalar<T>};
+}
+
+}  // namespace simd
+
+
+template <typename T>
+inline const SimdKernels<T>& GetSimdKernels() {
+    static const SimdKernels<T> kernels = simd::selectKernels<T>();
+    return kernels;
+}
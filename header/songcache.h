@@ -0,0 +1,109 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <cstdint>
+#include <header/client.h>
+
+
+// songID-indexed song metadata, bulk-loaded once from a DBClient. Titles and
+// artists are interned into one string arena, so an artist with many songs is
+// stored once and a lookup is two array reads. Songs that are not cached are
+// fetched with one GetSongsByIDs call and added. Safe to share between threads.
+class SongCache {
+public:
+    bool Load(DBClient& db) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        return db.ExportSongs([&](uint32_t songID, const Song& song) {
+            put(songID, song);
+        });
+    }
+
+    std::vector<std::optional<Song>> Get(DBClient& db, const std::vector<uint32_t>& songIDs) {
+        std::vector<std::optional<Song>> result(songIDs.size());
+        std::vector<uint32_t> missing;
+        std::vector<size_t> missingIndex;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            for (size_t i = 0; i < songIDs.size(); i++) {
+                result[i] = find(songIDs[i]);
+                if (!result[i]) {
+                    missing.push_back(songIDs[i]);
+                    missingIndex.push_back(i);
+                }
+            }
+        }
+        if (missing.empty()) return result;
+
+        auto fetched = db.GetSongsByIDs(missing);
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (size_t i = 0; i < missing.size(); i++) {
+            if (!fetched[i]) continue;
+            put(missing[i], *fetched[i]);
+            result[missingIndex[i]] = std::move(fetched[i]);
+        }
+        return result;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return count;
+    }
+
+private:
+    static const uint32_t NONE = UINT32_MAX;
+
+    struct Entry {
+        uint32_t title = NONE;
+        uint32_t artist = NONE;
+    };
+
+    struct StringRef {
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    std::vector<Entry> entries;                          // indexed by songID
+    std::vector<StringRef> strings;
+    std::string arena;
+    std::unordered_multimap<size_t, uint32_t> interned;  // hash -> strings index
+    size_t count = 0;
+    mutable std::shared_mutex mutex;
+
+    std::optional<Song> find(uint32_t songID) const {
+        if (songID >= entries.size() || entries[songID].title == NONE) return std::nullopt;
+        return Song{str(entries[songID].title), str(entries[songID].artist)};
+    }
+
+    void put(uint32_t songID, const Song& song) {
+        if (songID >= entries.size()) {
+            entries.resize(static_cast<size_t>(songID) + 1);
+        }
+        if (entries[songID].title == NONE) count++;
+        entries[songID].title = intern(song.title);
+        entries[songID].artist = intern(song.artist);
+    }
+
+    std::string str(uint32_t index) const {
+        return arena.substr(strings[index].offset, strings[index].length);
+    }
+
+    uint32_t intern(const std::string& value) {
+        size_t hash = std::hash<std::string>{}(value);
+        auto range = interned.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            const StringRef& ref = strings[it->second];
+            if (ref.length == value.size() && arena.compare(ref.offset, ref.length, value) == 0) {
+                return it->second;
+            }
+        }
+        uint32_t index = static_cast<uint32_t>(strings.size());
+        strings.push_back(StringRef{arena.size(), static_cast<uint32_t>(value.size())});
+        arena += value;
+        interned.emplace(hash, index);
+        return index;
+    }
+};
@@ -1,143 +1,188 @@
+#pragma once
 #include <iostream>
 #include <vector>
 #include <complex>
 #include <cmath>
 #include <stdexcept>
 #include <numeric> 
+#include <algorithm>
+#include <mutex>
 #include <header/fft.h>
 #include <header/filter.h>
 #include <header/models.h>
+#include <header/parallel.h>
 
-// Constants
-const int DSP_RATIO = 4;
-const int FREQ_BIN_SIZE = 1024;
-const int MAX_FREQ = 5000;  // 5 kHz
-const int HOP_SIZE = FREQ_BIN_SIZE / 32;
+#include <header/fingerprintconfig.h>
+
+const size_t MIN_FRAMES_PER_TASK = 16;  // Smallest share of frames handed to one thread
 
 // Complex type for frequency domain data
 using Complex = std::complex<double>;
 
 
-// Downsample function
-std::vector<double> Downsample(const std::vector<double>& input, int originalSampleRate, int targetSampleRate) {
-    if (targetSampleRate <= 0 || originalSampleRate <= 0) {
-        throw std::invalid_argument("Sample rates must be positive");
-    }
-    if (targetSampleRate > originalSampleRate) {
-        throw std::invalid_argument("Target sample rate must be less than or equal to original sample rate");
+// Magnitudes of the bins the peak picker scans, stored as one contiguous
+// row-major allocation.
+class SpectrogramBuffer {
+public:
+    SpectrogramBuffer() = default;
+    SpectrogramBuffer(size_t windows, size_t bins, double frameDuration)
+        : windows(windows), bins(bins), frameDuration(frameDuration), data(windows * bins) {}
+
+    size_t size() const { return windows; }
+    bool empty() const { return windows == 0; }
+    size_t Bins() const { return bins; }
+    // Seconds between the starts of consecutive windows
+    double FrameDuration() const { return frameDuration; }
+
+    const float* operator[](size_t window) const { return data.data() + window * bins; }
+    float* Magnitudes(size_t window) { return data.data() + window * bins; }
+
+private:
+    size_t windows = 0;
+    size_t bins = 0;
+    double frameDuration = 0.0;
+    std::vector<float> data;
+};
+
+
+// Turns one Config::FrameSize window of downsampled audio into a spectrogram
+// row. Holds the scratch buffers for the FFT, so use one instance per thread.
+template <typename Config>
+class FrameAnalyzer {
+private:
+    const RealFFTPlan& plan;
+    const SimdKernels<double>& simd;
+    std::vector<double> window;
+    std::vector<double> bin;
+    std::vector<Complex> spectrum;
+    std::vector<double> squaredMags;
+
+public:
+    FrameAnalyzer()
+        : plan(GetRealFFTPlan(Config::FrameSize)), simd(GetSimdKernels<double>()),
+          window(Config::FrameSize), bin(Config::FrameSize), spectrum(plan.Bins()), squaredMags(Config::PeakBins) {
+        // Hamming window
+        for (int i = 0; i < Config::FrameSize; ++i) {
+            window[i] = 0.54 - 0.46 * cos(2 * M_PI * i / (Config::FrameSize - 1));
+        }
     }
 
-    int ratio = originalSampleRate / targetSampleRate;
-    std::vector<double> resampled;
-    
-    for (size_t i = 0; i < input.size(); i += ratio) {
-        int end = std::min(i + ratio, input.size());
-        double sum = 0.0;
-        for (int j = i; j < end; ++j) {
-            sum += input[j];
+    // The window may be split in two segments (e.g. when read from a ring
+    // buffer); firstCount + secondCount must equal Config::FrameSize.
+    void Analyze(const double* first, size_t firstCount, const double* second, size_t secondCount,
+                 float* magnitude) {
+        simd.multiply(bin.data(), first, window.data(), firstCount);
+        simd.multiply(bin.data() + firstCount, second, window.data() + firstCount, secondCount);
+
+        // Apply FFT and keep only the bins the peak picker reads
+        plan.Transform(bin.data(), spectrum.data());
+        simd.squaredMagnitude(squaredMags.data(), spectrum.data(), Config::PeakBins);
+
+        for (int j = 0; j < Config::PeakBins; ++j) {
+            magnitude[j] = static_cast<float>(std::sqrt(squaredMags[j]));
         }
-        resampled.push_back(sum / (end - i));
     }
+};
 
-    return resampled;
-}
 
+// The calling thread's analyzer, so parallel loops reuse their FFT scratch
+template <typename Config>
+inline FrameAnalyzer<Config>& ThreadFrameAnalyzer() {
+    thread_local FrameAnalyzer<Config> analyzer;
+    return analyzer;
+}
 
-// Spectrogram function
-std::vector<std::vector<Complex>> Spectrogram(const std::vector<double>& samples, int sampleRate) {
-    LowPassFilter lpf(MAX_FREQ, static_cast<double>(sampleRate));
-    std::vector<double> filteredSamples = lpf.filter(samples);
 
-    std::vector<double> downsampledSamples = Downsample(filteredSamples, sampleRate, sampleRate / DSP_RATIO);
-    int numOfWindows = downsampledSamples.size() / (FREQ_BIN_SIZE - HOP_SIZE);
-    std::vector<std::vector<Complex>> spectrogram(numOfWindows);
+// Spectrogram function. Windows are independent and are analysed in parallel
+// on the DSP pool; each one writes its own row.
+template <typename Config = DefaultFingerprintConfig>
+inline SpectrogramBuffer Spectrogram(const std::vector<double>& samples, int sampleRate) {
+    PolyphaseResampler resampler(sampleRate, Config::AnalysisRate, Config::MaxFreq);
+    std::vector<double> downsampledSamples = resampler.Resample(samples);
 
-    
-    // Hamming window
-    std::vector<double> window(FREQ_BIN_SIZE);
-    for (int i = 0; i < FREQ_BIN_SIZE; ++i) {
-        window[i] = 0.54 - 0.46 * cos(2 * M_PI * i / (FREQ_BIN_SIZE - 1));
+    // One window every HopSize samples, as long as it fits in the signal
+    size_t numOfWindows = 0;
+    if (downsampledSamples.size() >= static_cast<size_t>(Config::FrameSize)) {
+        numOfWindows = (downsampledSamples.size() - Config::FrameSize) / Config::HopSize + 1;
     }
+    SpectrogramBuffer spectrogram(numOfWindows, Config::PeakBins,
+                                  Config::HopSize / static_cast<double>(Config::AnalysisRate));
 
     // Perform STFT
-    for (int i = 0; i < numOfWindows; ++i) {
-        int start = i * HOP_SIZE;
-        int end = start + FREQ_BIN_SIZE;
-        if (end > downsampledSamples.size()) {
-            end = downsampledSamples.size();
+    ParallelFor(numOfWindows, MIN_FRAMES_PER_TASK, [&](size_t begin, size_t end) {
+        FrameAnalyzer<Config>& analyzer = ThreadFrameAnalyzer<Config>();
+        for (size_t i = begin; i < end; ++i) {
+            const double* start = downsampledSamples.data() + i * Config::HopSize;
+            analyzer.Analyze(start, Config::FrameSize, nullptr, 0, spectrogram.Magnitudes(i));
         }
+    });
 
-        std::vector<double> bin(FREQ_BIN_SIZE, 0.0);
-        for (int j = start; j < end; ++j) {
-            bin[j - start] = downsampledSamples[j];
-        }
+    return spectrogram;
+}
 
-        // Apply Hamming window
-        for (size_t j = 0; j < bin.size(); ++j) {
-            bin[j] *= window[j];
-        }
 
-        // Apply FFT
-        spectrogram[i] = FFT(bin);
-    }
+// Appends the band peaks of one spectrogram row that rise above the band
+// average. The band table is a constant of the config, so the loops have
+// fixed bounds.
+template <typename Config = DefaultFingerprintConfig>
+inline void ExtractFramePeaks(const float* magnitude, size_t frameIdx, std::vector<Peak>& peaks) {
+    constexpr auto& bands = Config::Bands;
+    constexpr size_t numBands = bands.size();
 
-    return spectrogram;
-}
+    float maxMags[numBands];
+    int freqIndices[numBands];
 
-std::vector<Peak> ExtractPeaks(const std::vector<std::vector<Complex>>& spectrogram, double audioDuration) {
-    if (spectrogram.empty()) {
-        return {};
-    }
+    // Analyze frequency bands
+    for (size_t b = 0; b < numBands; ++b) {
+        float maxMag = 0.0f;
+        int freqIdx = bands[b].begin;
 
-    std::vector<Peak> peaks;
-    double binDuration = audioDuration / spectrogram.size();
-
-    // Frequency bands
-    std::vector<std::pair<int, int>> bands = {{0, 10}, {10, 20}, {20, 40}, {40, 80}, {80, 160}, {160, 512}};
-
-    for (size_t binIdx = 0; binIdx < spectrogram.size(); ++binIdx) {
-        std::vector<double> maxMags;
-        std::vector<Complex> maxFreqs;
-        std::vector<double> freqIndices;
-
-        // Analyze frequency bands
-        for (const auto& band : bands) {
-            double maxMag = 0.0;
-            Complex maxFreq;
-            int freqIdx = band.first;
-
-            for (int idx = band.first; idx < band.second; ++idx) {
-                double magnitude = std::abs(spectrogram[binIdx][idx]);
-                if (magnitude > maxMag) {
-                    maxMag = magnitude;
-                    maxFreq = spectrogram[binIdx][idx];
-                    freqIdx = idx;
-                }
+        for (int idx = bands[b].begin; idx < bands[b].end; ++idx) {
+            if (magnitude[idx] > maxMag) {
+                maxMag = magnitude[idx];
+                freqIdx = idx;
             }
-
-            maxMags.push_back(maxMag);
-            maxFreqs.push_back(maxFreq);
-            freqIndices.push_back(static_cast<double>(freqIdx));
         }
 
-        // Calculate average magnitude
-        double maxMagsSum = 0.0;
-        for (double mag : maxMags) {
-            maxMagsSum += mag;
-        }
-        double avg = maxMagsSum / maxFreqs.size();
+        maxMags[b] = maxMag;
+        freqIndices[b] = freqIdx;
+    }
 
-        // Add peaks
-        for (size_t i = 0; i < maxMags.size(); ++i) {
-            if (maxMags[i] > avg) {
-                double peakTimeInBin = freqIndices[i] * binDuration / spectrogram[binIdx].size();
-                double peakTime = binIdx * binDuration + peakTimeInBin;
+    // Calculate average magnitude
+    double maxMagsSum = 0.0;
+    for (float mag : maxMags) {
+        maxMagsSum += mag;
+    }
+    double avg = maxMagsSum / numBands;
 
-                peaks.push_back(Peak{peakTime, maxFreqs[i]});
-            }
+    // Add peaks
+    for (size_t i = 0; i < numBands; ++i) {
+        if (maxMags[i] > avg) {
+            peaks.push_back(Peak{static_cast<uint32_t>(frameIdx), static_cast<uint16_t>(freqIndices[i]), maxMags[i]});
         }
     }
+}
+
+
+// Rows are scanned in parallel; the per-chunk results are joined in frame order
+template <typename Config = DefaultFingerprintConfig>
+inline std::vector<Peak> ExtractPeaks(const SpectrogramBuffer& spectrogram) {
+    std::vector<std::pair<size_t, std::vector<Peak>>> parts;
+    std::mutex partsMutex;
+    ParallelFor(spectrogram.size(), MIN_FRAMES_PER_TASK, [&](size_t begin, size_t end) {
+        std::vector<Peak> part;
+        for (size_t binIdx = begin; binIdx < end; ++binIdx) {
+            ExtractFramePeaks<Config>(spectrogram[binIdx], binIdx, part);
+        }
+        std::lock_guard<std::mutex> lock(partsMutex);
+        parts.emplace_back(begin, std::move(part));
+    });
+    std::sort(parts.begin(), parts.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
 
+    std::vector<Peak> peaks;
+    for (const auto& part : parts) {
+        peaks.insert(peaks.end(), part.second.begin(), part.second.end());
+    }
     return peaks;
 }
 
@@ -149,7 +194,7 @@ std::vector<Peak> ExtractPeaks(const std::vector<std::vector<Complex>>& spectrog
 
 //     try {
 //         auto spectrogram = Spectrogram(samples, sampleRate);
-//         auto peaks = ExtractPeaks(spectrogram, audioDuration);
+//         auto peaks = ExtractPeaks(spectrogram);
 
 //         for (const auto& peak : peaks) {
 //             std::cout << "Peak at time: " << peak.Time << "s, frequency: " << std::abs(peak.Freq) << "Hz\n";
@@ -0,0 +1,86 @@
+#pragma once
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <header/filter.h>
+#include <header/spectogram.h>
+#include <header/models.h>
+
+
+// Buffers of the fingerprint pipeline that outlive one track, so a long-lived
+// caller (a server worker, an ingest thread) stops allocating once they have
+// grown to the size of its largest request. Resamplers, whose filter taps are
+// the costliest part to build, are kept for the MAX_CACHED_RESAMPLERS rate
+// pairs used last; the input rate comes from clients, so the cache is bounded
+// rather than growing with every rate it has seen.
+//
+// A workspace belongs to one thread and serves one FingerprintPipeline at a
+// time; the pipeline resets it when it starts.
+class DspWorkspace {
+public:
+    // Resampler from inputRate to outputRate, rewound to a new signal
+    PolyphaseResampler& Resampler(int inputRate, int outputRate, int maxFreq) {
+        auto key = std::make_tuple(inputRate, outputRate, maxFreq);
+        CachedResampler* entry = nullptr;
+        for (CachedResampler& cached : resamplers) {
+            if (cached.key == key) entry = &cached;
+        }
+        if (!entry) {
+            if (resamplers.size() < MAX_CACHED_RESAMPLERS) {
+                resamplers.reserve(MAX_CACHED_RESAMPLERS);
+                resamplers.emplace_back();
+                entry = &resamplers.back();
+            } else {
+                entry = &*std::min_element(resamplers.begin(), resamplers.end(),
+                    [](const CachedResampler& a, const CachedResampler& b) { return a.lastUse < b.lastUse; });
+            }
+            // Drop the evicted filter before building the new one
+            entry->resampler.reset();
+            entry->resampler = std::make_unique<PolyphaseResampler>(inputRate, outputRate, maxFreq);
+            entry->key = key;
+        }
+        entry->lastUse = ++useCount;
+        entry->resampler->Reset();
+        return *entry->resampler;
+    }
+
+    // Spectrogram rows for a batch of frames
+    SpectrogramBuffer& Rows(size_t frames, size_t bins, double frameDuration) {
+        if (rows.size() < frames || rows.Bins() != bins || rows.FrameDuration() != frameDuration) {
+            rows = SpectrogramBuffer(frames, bins, frameDuration);
+        }
+        return rows;
+    }
+
+    // Clears the buffers, keeping their capacity
+    void Reset() {
+        resampled.clear();
+        samples.clear();
+        for (std::vector<Peak>& peaks : framePeaks) {
+            peaks.clear();
+        }
+        pending.clear();
+        hashes.clear();
+    }
+
+    std::vector<double> resampled;            // One block of resampler output
+    std::vector<double> samples;              // Audio at the analysis rate not yet analysed
+    std::vector<std::vector<Peak>> framePeaks;  // Peaks of each frame of a batch
+    std::vector<Peak> pending;                // Anchors waiting for their target zone
+    std::vector<FingerprintHash> hashes;      // Free for the caller, e.g. FindMatch
+
+private:
+    static constexpr size_t MAX_CACHED_RESAMPLERS = 4;
+
+    struct CachedResampler {
+        std::tuple<int, int, int> key;
+        uint64_t lastUse = 0;
+        std::unique_ptr<PolyphaseResampler> resampler;
+    };
+
+    std::vector<CachedResampler> resamplers;
+    uint64_t useCount = 0;
+    SpectrogramBuffer rows;
+};
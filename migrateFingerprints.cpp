@@ -0,0 +1,45 @@
+#include <iostream>
+#include <chrono>
+#include <header/mongo.h>
+
+
+// Converts the fingerprints collection of the current hash version to the
+// packed schema (one binary blob of Couple structs per address), or with
+// --compact merges the blobs appended to the packed collection since the last
+// run. Query and ingest use the packed schema with DB_FINGERPRINT_SCHEMA=packed.
+// Either mode may run, and be re-run, while ingest writes to the packed
+// collection: existing blobs are merged, not overwritten.
+int main(int argc, char** argv) {
+    bool compact = argc == 2 && std::string(argv[1]) == "--compact";
+    if (argc > 2 || (argc == 2 && !compact)) {
+        std::cerr << "Usage: ./migrate-fingerprints [--compact]" << std::endl;
+        return 1;
+    }
+
+    std::string from = FingerprintCollectionName(compact);
+    std::string to = FingerprintCollectionName(true);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    MongoClient db;
+    if (!db.Connect()) {
+        std::cerr << "Database connection failed." << std::endl;
+        return 1;
+    }
+
+    int64_t sizeBefore = db.StorageSize(from);
+    size_t migrated = 0;
+    if (!db.MigrateFingerprints(from, to, migrated)) {
+        std::cerr << "Migration failed after " << migrated << " addresses." << std::endl;
+        return 1;
+    }
+    int64_t sizeAfter = db.StorageSize(to);
+
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "Rewrote " << migrated << " addresses from " << from << " to " << to
+              << " in " << elapsed.count() << " seconds" << std::endl;
+    if (sizeBefore >= 0 && sizeAfter >= 0) {
+        std::cout << "Storage: " << from << " " << sizeBefore / 1048576.0 << " MiB, "
+                  << to << " " << sizeAfter / 1048576.0 << " MiB" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,382 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <header/client.h>
+#include <header/match.h>
+#include <header/audio.h>
+#include <header/queue.h>
+#include <header/songcache.h>
+#include <header/workspace.h>
+#include <header/utils.h>
+
+
+// Long-lived query server. Loads the backend once, keeps its connections warm
+// and answers HTTP requests from a pool of worker threads on a local port:
+//
+//   POST /match?format=pcm&rate=44100[&channels=2]   raw s16le PCM body
+//   POST /match?ext=mp3                              encoded file body
+//   GET  /health
+//   GET  /metrics                                    backend counters
+//
+// Matches are returned as JSON, best first. Audio must be between
+// MIN_SAMPLE_RATE and MAX_SAMPLE_RATE.
+
+#define MAX_REQUEST_BYTES (64 << 20)
+#define MIN_SAMPLE_RATE 8000
+#define MAX_SAMPLE_RATE 192000
+#define REQUEST_TIMEOUT_SECONDS 10   // Per socket read/write, and for reading a whole request
+
+
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> query;
+    std::string body;
+};
+
+
+static std::string jsonEscape(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+
+static std::string matchesToJson(const std::vector<Match>& matches, double searchSeconds) {
+    std::ostringstream json;
+    json << "{\"matches\":[";
+    for (size_t i = 0; i < matches.size(); i++) {
+        const Match& match = matches[i];
+        if (i > 0) json << ",";
+        json << "{\"songID\":" << match.songID
+             << ",\"title\":\"" << jsonEscape(match.songTitle) << "\""
+             << ",\"artist\":\"" << jsonEscape(match.songArtist) << "\""
+             << ",\"timestamp\":" << match.timestamp
+             << ",\"score\":" << match.score << "}";
+    }
+    json << "],\"searchSeconds\":" << searchSeconds << "}";
+    return json.str();
+}
+
+
+static std::string metricsToJson(const std::map<std::string, double>& metrics) {
+    std::ostringstream json;
+    json << "{";
+    for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+        if (it != metrics.begin()) json << ",";
+        json << "\"" << jsonEscape(it->first) << "\":" << it->second;
+    }
+    json << "}";
+    return json.str();
+}
+
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+
+static void sendResponse(int fd, int status, const std::string& reason, const std::string& body) {
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << " " << reason << "\r\n"
+             << "Content-Type: application/json\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    sendAll(fd, response.str());
+}
+
+
+static void sendError(int fd, int status, const std::string& reason, const std::string& message) {
+    sendResponse(fd, status, reason, "{\"error\":\"" + jsonEscape(message) + "\"}");
+}
+
+
+// Reads one request; the connection is closed after the response. Gives up
+// once the request has taken REQUEST_TIMEOUT_SECONDS, so a client that
+// trickles bytes cannot hold a worker.
+static bool readRequest(int fd, HttpRequest& request) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(REQUEST_TIMEOUT_SECONDS);
+    std::string data;
+    char buf[16384];
+    size_t headerEnd = std::string::npos;
+    while (headerEnd == std::string::npos) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0 || data.size() > MAX_REQUEST_BYTES || std::chrono::steady_clock::now() > deadline) return false;
+        data.append(buf, static_cast<size_t>(n));
+        headerEnd = data.find("\r\n\r\n");
+    }
+
+    std::istringstream head(data.substr(0, headerEnd));
+    std::string target, line;
+    head >> request.method >> target;
+    std::getline(head, line);
+
+    size_t contentLength = 0;
+    while (std::getline(head, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        for (char& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (name == "content-length") {
+            contentLength = static_cast<size_t>(std::strtoull(line.c_str() + colon + 1, nullptr, 10));
+        }
+    }
+    if (contentLength > MAX_REQUEST_BYTES) return false;
+
+    size_t queryPos = target.find('?');
+    request.path = target.substr(0, queryPos);
+    if (queryPos != std::string::npos) {
+        std::istringstream params(target.substr(queryPos + 1));
+        std::string param;
+        while (std::getline(params, param, '&')) {
+            size_t eq = param.find('=');
+            if (eq == std::string::npos) request.query[param] = "";
+            else request.query[param.substr(0, eq)] = param.substr(eq + 1);
+        }
+    }
+
+    request.body = data.substr(headerEnd + 4);
+    while (request.body.size() < contentLength) {
+        ssize_t n = ::recv(fd, buf, std::min(sizeof(buf), contentLength - request.body.size()), 0);
+        if (n <= 0 || std::chrono::steady_clock::now() > deadline) return false;
+        request.body.append(buf, static_cast<size_t>(n));
+    }
+    request.body.resize(contentLength);
+    return true;
+}
+
+
+static std::string queryParam(const HttpRequest& request, const std::string& key, const std::string& defaultValue) {
+    auto it = request.query.find(key);
+    return it == request.query.end() ? defaultValue : it->second;
+}
+
+
+// Raw interleaved s16le PCM, downmixed to mono
+static std::vector<double> decodePCM(const std::string& body, int channels) {
+    size_t frames = body.size() / (sizeof(int16_t) * channels);
+    std::vector<double> samples(frames);
+    const char* in = body.data();
+    for (size_t i = 0; i < frames; i++) {
+        double sum = 0.0;
+        for (int c = 0; c < channels; c++) {
+            int16_t value;
+            std::memcpy(&value, in + (i * channels + c) * sizeof(int16_t), sizeof(int16_t));
+            sum += value;
+        }
+        samples[i] = sum / (32768.0 * channels);
+    }
+    return samples;
+}
+
+
+// Encoded audio goes through the same decoders as the CLI, via a temp file
+static std::vector<double> decodeEncoded(const std::string& body, const std::string& ext, long& sampleRate) {
+    std::string suffix = "." + ext;
+    std::string pattern = (fs::temp_directory_path() / ("shazam-query-XXXXXX" + suffix)).string();
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+
+    int fd = ::mkstemps(path.data(), static_cast<int>(suffix.size()));
+    if (fd < 0) {
+        throw std::runtime_error("Could not create a temp file.");
+    }
+    bool written = true;
+    for (size_t off = 0; off < body.size() && written;) {
+        ssize_t n = ::write(fd, body.data() + off, body.size() - off);
+        written = n > 0;
+        off += written ? static_cast<size_t>(n) : 0;
+    }
+    ::close(fd);
+
+    std::vector<double> samples;
+    if (written) {
+        auto [decoded, rate, channels, duration] = decodeAudioFile(path.data());
+        samples = std::move(decoded);
+        sampleRate = rate;
+    }
+    ::unlink(path.data());
+    return samples;
+}
+
+
+static void handleMatch(int fd, const HttpRequest& request, DBClient& db, SongCache& songs, DspWorkspace& workspace) {
+    std::vector<double> samples;
+    long sampleRate = 0;
+
+    if (queryParam(request, "format", "") == "pcm") {
+        sampleRate = std::atol(queryParam(request, "rate", "44100").c_str());
+        int channels = std::max(1, std::atoi(queryParam(request, "channels", "1").c_str()));
+        samples = decodePCM(request.body, channels);
+    } else {
+        std::string ext = queryParam(request, "ext", "wav");
+        if (ext.empty() || ext.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789") != std::string::npos) {
+            sendError(fd, 400, "Bad Request", "Invalid ext parameter.");
+            return;
+        }
+        samples = decodeEncoded(request.body, ext, sampleRate);
+    }
+    if (samples.empty()) {
+        sendError(fd, 400, "Bad Request", "Error decoding audio.");
+        return;
+    }
+    // The resampler filter grows with the rate, so absurd rates are refused
+    // before any DSP state is built for them
+    if (sampleRate < MIN_SAMPLE_RATE || sampleRate > MAX_SAMPLE_RATE) {
+        sendError(fd, 400, "Bad Request", "Sample rate must be between " + std::to_string(MIN_SAMPLE_RATE) +
+                  " and " + std::to_string(MAX_SAMPLE_RATE) + " Hz.");
+        return;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<Match> matches = FindMatch(db, samples, static_cast<double>(sampleRate), &songs,
+                                            MAX_MATCH_RESULTS, &workspace);
+    std::chrono::duration<double> searchDuration = std::chrono::high_resolution_clock::now() - start;
+
+    sendResponse(fd, 200, "OK", matchesToJson(matches, searchDuration.count()));
+}
+
+
+static void handleConnection(int fd, DBClient& db, SongCache& songs, DspWorkspace& workspace) {
+    HttpRequest request;
+    if (!readRequest(fd, request)) {
+        sendError(fd, 400, "Bad Request", "Malformed request.");
+        return;
+    }
+
+    try {
+        if (request.method == "GET" && request.path == "/health") {
+            sendResponse(fd, 200, "OK", "{\"status\":\"ok\"}");
+        } else if (request.method == "GET" && request.path == "/metrics") {
+            sendResponse(fd, 200, "OK", metricsToJson(db.Metrics()));
+        } else if (request.method == "POST" && request.path == "/match") {
+            handleMatch(fd, request, db, songs, workspace);
+        } else {
+            sendError(fd, 404, "Not Found", "Unknown endpoint.");
+        }
+    } catch (const std::exception& e) {
+        sendError(fd, 500, "Internal Server Error", e.what());
+    }
+}
+
+
+// Each worker keeps its DSP buffers across requests
+static void QueryWorker(BoundedQueue<int>& connections, DBClient& db, SongCache& songs) {
+    DspWorkspace workspace;
+    while (auto fd = connections.Pop()) {
+        if (!db.IsConnected() && !db.Connect()) {
+            sendError(*fd, 503, "Service Unavailable", "Database connection failed.");
+        } else {
+            handleConnection(*fd, db, songs, workspace);
+        }
+        ::close(*fd);
+    }
+}
+
+
+int main(int argc, char** argv) {
+    int port = std::atoi(getEnv("SERVER_PORT", "8080").c_str());
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    if (argc == 3 && std::string(argv[1]) == "--workers") {
+        workers = static_cast<unsigned>(std::max(1, std::atoi(argv[2])));
+    } else if (argc != 1) {
+        std::cerr << "Usage: ./shazam-server [--workers N]" << std::endl;
+        return 1;
+    }
+
+    // One client shared by all workers; the Mongo backend hands each query a
+    // pooled connection
+    std::unique_ptr<DBClient> db = NewDBClient();
+    if (!db->Connect()) {
+        std::cerr << "Database connection failed." << std::endl;
+        return 1;
+    }
+
+    // Song metadata is loaded once and shared by all workers
+    SongCache songs;
+    if (songs.Load(*db)) {
+        std::cout << "Cached " << songs.size() << " songs" << std::endl;
+    } else {
+        std::cerr << "Warning: could not preload song metadata, fetching it on demand" << std::endl;
+    }
+
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = ::inet_addr(getEnv("SERVER_HOST", "127.0.0.1").c_str());
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listener, 128) != 0) {
+        std::cerr << "Could not listen on port " << port << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    BoundedQueue<int> connections(workers * 4);
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < workers; i++) {
+        pool.emplace_back(QueryWorker, std::ref(connections), std::ref(*db), std::ref(songs));
+    }
+    std::cout << "Listening on port " << port << " with " << workers << " workers" << std::endl;
+
+    while (true) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            // Out of descriptors: give the workers a moment to close some
+            if (errno == EMFILE || errno == ENFILE) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+        timeval timeout{REQUEST_TIMEOUT_SECONDS, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        connections.Push(fd);
+    }
+
+    connections.Close();
+    for (auto& thread : pool) thread.join();
+    ::close(listener);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+#include <header/pipeline.h>
+
+
+// Counts every heap allocation in the process, on any thread. new and delete
+// both go through these out-of-line helpers so the compiler does not see a
+// malloc/free pair it would flag as mismatched with new/delete.
+static std::atomic<size_t> allocations{0};
+
+__attribute__((noinline)) static void* countedAlloc(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) static void countedFree(void* p) noexcept {
+    std::free(p);
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+
+// Fingerprints a clip the way a server worker does: the hashes go into the
+// workspace, which is kept across requests
+static size_t fingerprint(DspWorkspace& workspace, const std::vector<double>& clip, int sampleRate,
+                          FingerprintPreset preset) {
+    FingerprintPipeline pipeline(sampleRate,
+        [&](const FingerprintHash& hash) {
+            workspace.hashes.push_back(hash);
+        }, nullptr, &workspace, preset);
+    pipeline.Push(clip);
+    pipeline.Finish();
+    return pipeline.Couples();
+}
+
+
+// A second identical query on a warmed-up workspace must not touch the heap
+int main() {
+    const int sampleRate = 44100;
+    std::vector<double> clip(sampleRate * 10);
+    for (size_t n = 0; n < clip.size(); n++) {
+        double t = static_cast<double>(n) / sampleRate;
+        clip[n] = std::sin(2 * M_PI * 440 * t) + 0.5 * std::sin(2 * M_PI * (300 + 200 * std::floor(t * 4)) * t);
+    }
+
+    bool passed = true;
+    for (FingerprintPreset preset : {FingerprintPreset::Balanced, FingerprintPreset::Fast, FingerprintPreset::Accurate}) {
+        DspWorkspace workspace;
+        size_t first = fingerprint(workspace, clip, sampleRate, preset);
+
+        size_t before = allocations.load();
+        size_t second = fingerprint(workspace, clip, sampleRate, preset);
+        size_t allocated = allocations.load() - before;
+
+        std::cout << FingerprintPresetName(preset) << ": " << second << " couples, "
+                  << allocated << " allocations on the second query" << std::endl;
+        if (first == 0 || second != first || allocated != 0) {
+            passed = false;
+        }
+    }
+    return passed ? 0 : 1;
+}
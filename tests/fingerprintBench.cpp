@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <header/match.h>
+#include <header/memory.h>
+
+
+// Offline comparisons of the matcher against the implementations it replaced,
+// on seeded synthetic audio, so results are the same on every run. Each
+// section is one ctest test; run `fingerprint-bench <section>` for the numbers.
+
+#define BENCH_SAMPLE_RATE 22050
+
+
+// Tracks of three voices, each gliding continuously to a new pitch every
+// 40 ms, between 440 Hz and 3.5 kHz. The peaks move from frame to frame the
+// way they do in real recordings, and tracks only share the addresses that
+// land in the same bins by chance.
+static std::vector<double> synthTrack(double seconds, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> interval(-4.0, 4.0);  // Semitones
+    std::vector<double> samples(static_cast<size_t>(BENCH_SAMPLE_RATE * seconds));
+    size_t note = BENCH_SAMPLE_RATE / 25;
+    double pitches[3] = {30.0, 42.0, 54.0};  // Semitones above 110 Hz
+    double phases[3] = {0.0, 0.0, 0.0};
+    for (size_t start = 0; start < samples.size(); start += note) {
+        for (int voice = 0; voice < 3; voice++) {
+            double from = pitches[voice];
+            double step = interval(random);
+            pitches[voice] = from + step < 24.0 || from + step > 60.0 ? from - step : from + step;
+            for (size_t n = start; n < std::min(samples.size(), start + note); n++) {
+                double pitch = from + (pitches[voice] - from) * static_cast<double>(n - start) / note;
+                samples[n] += 0.3 * std::sin(phases[voice]);
+                phases[voice] += 2 * M_PI * 110.0 * std::pow(2.0, pitch / 12.0) / BENCH_SAMPLE_RATE;
+            }
+        }
+    }
+    return samples;
+}
+
+static std::vector<FingerprintHash> fingerprint(const std::vector<double>& samples) {
+    std::vector<FingerprintHash> hashes;
+    FingerprintPipeline pipeline(BENCH_SAMPLE_RATE, [&](const FingerprintHash& hash) { hashes.push_back(hash); });
+    pipeline.Push(samples);
+    pipeline.Finish();
+    return hashes;
+}
+
+struct Query {
+    uint32_t songID;
+    uint32_t startMs;
+    std::vector<double> clip;
+};
+
+// Clips of `seconds` from random tracks at random millisecond offsets, with
+// white noise of deviation `noise` added
+static std::vector<Query> synthQueries(const std::vector<std::vector<double>>& tracks, size_t count,
+                                       double seconds, double noise, unsigned seed) {
+    std::mt19937 random(seed);
+    std::normal_distribution<double> gaussian(0.0, noise);
+    size_t length = static_cast<size_t>(BENCH_SAMPLE_RATE * seconds);
+    std::vector<Query> queries;
+    for (size_t q = 0; q < count; q++) {
+        size_t track = random() % tracks.size();
+        uint32_t startMs = static_cast<uint32_t>(random() % ((tracks[track].size() - length) * 1000 / BENCH_SAMPLE_RATE));
+        size_t start = static_cast<size_t>(startMs) * BENCH_SAMPLE_RATE / 1000;
+        Query query{static_cast<uint32_t>(track + 1), startMs,
+                    std::vector<double>(tracks[track].begin() + start, tracks[track].begin() + start + length)};
+        for (double& sample : query.clip) sample += gaussian(random);
+        queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+
+
+// ---------------------------------------------------------------------------
+// scorer: the offset histogram of FindMatch (scoreOffsets) against the
+// pairwise scorer it replaced (analyzeRelativeTiming), on the same hits.
+//
+// The hits have the shape the pairwise scorer was written for, from before
+// fingerprints kept repeated addresses: one anchor time per address in the
+// clip and in each track, the last one seen. With every repeat kept a track
+// has far more hits, and the quadratic scorer would take minutes per query.
+
+// The scorer before offset histograms, kept as the reference: one point per
+// pair of hits whose clip and track time differences agree within 100 ms
+static double pairwiseScore(const std::vector<std::pair<uint32_t, uint32_t>>& times) {
+    int count = 0;
+    for (size_t i = 0; i < times.size(); ++i) {
+        for (size_t j = i + 1; j < times.size(); ++j) {
+            double sampleDiff = std::abs(static_cast<double>(times[i].first) - times[j].first);
+            double dbDiff = std::abs(static_cast<double>(times[i].second) - times[j].second);
+            if (std::abs(sampleDiff - dbDiff) < 100) {
+                count++;
+            }
+        }
+    }
+    return static_cast<double>(count);
+}
+
+static std::unordered_map<uint32_t, uint32_t> lastTimes(const std::vector<FingerprintHash>& hashes) {
+    std::unordered_map<uint32_t, uint32_t> times;
+    for (const FingerprintHash& hash : hashes) times[hash.address] = hash.anchorTimeMs;
+    return times;
+}
+
+// Track indices, best score first; ties go to the lower index as in a
+// stable sort of songs in ID order
+static std::vector<size_t> ranking(const std::vector<double>& scores) {
+    std::vector<size_t> order(scores.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scores[a] > scores[b]; });
+    return order;
+}
+
+static bool scorerSection() {
+    const size_t trackCount = 50, topK = 5;
+    std::vector<std::vector<double>> tracks;
+    std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> index;  // address -> (track, time)
+    for (size_t t = 0; t < trackCount; t++) {
+        tracks.push_back(synthTrack(20.0, 100 + static_cast<unsigned>(t)));
+        for (const auto& [address, time] : lastTimes(fingerprint(tracks.back()))) {
+            index[address].emplace_back(static_cast<uint32_t>(t), time);
+        }
+    }
+    std::cout << "scorer: 50 queries of 4 s over " << trackCount << " tracks" << std::endl;
+    bool passed = true;
+    for (double noise : {0.5, 3.0}) {
+        auto queries = synthQueries(tracks, 50, 4.0, noise, 7);
+
+        size_t pairwiseCorrect = 0, histogramCorrect = 0, sameTop = 0, sharedTopK = 0;
+        size_t histogramOffsets = 0, pairwiseOffsets = 0;
+        for (const Query& query : queries) {
+            std::vector<std::vector<std::pair<uint32_t, uint32_t>>> times(trackCount);
+            for (const auto& [address, clipTime] : lastTimes(fingerprint(query.clip))) {
+                auto it = index.find(address);
+                if (it == index.end()) continue;
+                for (const auto& [track, time] : it->second) times[track].emplace_back(clipTime, time);
+            }
+
+            std::vector<double> pairwise(trackCount), histogram(trackCount);
+            std::vector<int64_t> offsets(trackCount);
+            for (size_t t = 0; t < trackCount; t++) {
+                pairwise[t] = pairwiseScore(times[t]);
+                OffsetScore score = scoreOffsets(times[t]);
+                histogram[t] = score.score;
+                offsets[t] = score.offsetMs;
+            }
+            std::vector<size_t> pairwiseRanking = ranking(pairwise), histogramRanking = ranking(histogram);
+
+            size_t truth = query.songID - 1;
+            pairwiseCorrect += pairwiseRanking[0] == truth;
+            histogramCorrect += histogramRanking[0] == truth;
+            sameTop += pairwiseRanking[0] == histogramRanking[0];
+            for (size_t i = 0; i < topK; i++) {
+                sharedTopK += std::count(histogramRanking.begin(), histogramRanking.begin() + topK, pairwiseRanking[i]);
+            }
+
+            // The pairwise scorer reported the earliest matched track time
+            if (histogramRanking[0] == truth && std::abs(offsets[truth] - query.startMs) < 2 * OFFSET_BIN_MS) {
+                histogramOffsets++;
+            }
+            if (pairwiseRanking[0] == truth) {
+                uint32_t earliest = UINT32_MAX;
+                for (const auto& entry : times[truth]) earliest = std::min(earliest, entry.second);
+                pairwiseOffsets += std::abs(static_cast<int64_t>(earliest) - query.startMs) < 2 * OFFSET_BIN_MS;
+            }
+        }
+
+        std::cout << "  noise sd " << noise << ": top-1 correct: pairwise " << pairwiseCorrect << ", histogram " << histogramCorrect
+                  << "; same top-1 " << sameTop << ", shared top-" << topK << " " << sharedTopK << "/" << queries.size() * topK << std::endl;
+        std::cout << "    offset within " << 2 * OFFSET_BIN_MS << " ms of the clip start: pairwise (earliest hit) "
+                  << pairwiseOffsets << "/" << pairwiseCorrect << ", histogram " << histogramOffsets << "/" << histogramCorrect << std::endl;
+        passed = passed && histogramCorrect >= pairwiseCorrect && histogramOffsets == histogramCorrect;
+    }
+    return passed;
+}
+
+
+
+// ---------------------------------------------------------------------------
+// hashes: addresses of version 2 (bin indices and a frame delta) against
+// version 1 (the real part of the FFT coefficient and a millisecond delta),
+// built from the same peaks of the balanced preset, the one v1 shipped with.
+// Recall is the share of clip hashes whose address the track has at the clip
+// start plus their anchor time, within HASH_TOLERANCE_MS. Clips start at random
+// samples, so they are not aligned with the analysis hop. The same count at an
+// offset HASH_CHANCE_SHIFT_MS away is the chance rate: v1 addresses collide so
+// often that most of their aligned hits are chance, and the schemes are
+// compared on recall above it. Only v2 is timed: the v1 spectrogram, which
+// kept the complex coefficients, is gone, and the reference above recomputes
+// one DFT coefficient per peak.
+
+#define HASH_TOLERANCE_MS 60
+#define HASH_CHANCE_SHIFT_MS 3000.0
+
+struct SchemeHashes {
+    std::vector<FingerprintHash> v1;
+    std::vector<FingerprintHash> v2;
+};
+
+// The address before FINGERPRINT_HASH_VERSION 2, kept as the reference. Peaks
+// carried their time in seconds and their FFT coefficient then.
+static uint32_t createAddressV1(double anchorTime, double anchorReal, double targetTime, double targetReal) {
+    const int maxfreqBits = 9;
+    const int maxDeltaBits = 14;
+    int anchorFreq = static_cast<int>(anchorReal);
+    int targetFreq = static_cast<int>(targetReal);
+    uint32_t deltaMs = static_cast<uint32_t>((targetTime - anchorTime) * 1000);
+
+    return (static_cast<uint32_t>(anchorFreq) << (maxDeltaBits + maxfreqBits)) |
+           (static_cast<uint32_t>(targetFreq) << maxDeltaBits) |
+           deltaMs;
+}
+
+static SchemeHashes fingerprintBoth(const std::vector<double>& samples) {
+    using Config = BalancedFingerprintConfig;
+    SchemeHashes hashes;
+    std::vector<Peak> peaks;
+    BasicFingerprintPipeline<Config> pipeline(BENCH_SAMPLE_RATE, [&](const FingerprintHash& hash) { hashes.v2.push_back(hash); },
+                                              [&](const Peak& peak) { peaks.push_back(peak); });
+    pipeline.Push(samples);
+    pipeline.Finish();
+
+    // The real part of the Hamming-windowed DFT at the peak bin, from the
+    // same resampled signal the pipeline analysed
+    PolyphaseResampler resampler(BENCH_SAMPLE_RATE, Config::AnalysisRate, Config::MaxFreq);
+    std::vector<double> resampled = resampler.Resample(samples);
+    std::vector<double> window(Config::FrameSize), cosine(Config::FrameSize);
+    for (int i = 0; i < Config::FrameSize; i++) {
+        window[i] = 0.54 - 0.46 * std::cos(2 * M_PI * i / (Config::FrameSize - 1));
+        cosine[i] = std::cos(2 * M_PI * i / Config::FrameSize);
+    }
+    std::vector<double> times(peaks.size()), reals(peaks.size());
+    for (size_t p = 0; p < peaks.size(); p++) {
+        const double* frame = resampled.data() + static_cast<size_t>(peaks[p].frame) * Config::HopSize;
+        double real = 0.0;
+        for (int i = 0; i < Config::FrameSize; i++) {
+            real += frame[i] * window[i] * cosine[(static_cast<size_t>(peaks[p].bin) * i) % Config::FrameSize];
+        }
+        times[p] = static_cast<double>(peaks[p].frame) * Config::HopSize / Config::AnalysisRate;
+        reals[p] = real;
+    }
+
+    for (size_t i = 0; i < peaks.size(); i++) {
+        for (size_t j = i + 1; j < peaks.size() && j <= i + Config::TargetZoneSize; j++) {
+            hashes.v1.push_back({createAddressV1(times[i], reals[i], times[j], reals[j]),
+                                 static_cast<uint32_t>(times[i] * 1000)});
+        }
+    }
+    return hashes;
+}
+
+static std::unordered_map<uint32_t, std::vector<uint32_t>> addressTimes(const std::vector<FingerprintHash>& hashes) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> times;
+    for (const FingerprintHash& hash : hashes) times[hash.address].push_back(hash.anchorTimeMs);
+    return times;
+}
+
+static size_t alignedHits(const std::unordered_map<uint32_t, std::vector<uint32_t>>& track,
+                          const std::vector<FingerprintHash>& clip, double startMs) {
+    size_t hits = 0;
+    for (const FingerprintHash& hash : clip) {
+        auto it = track.find(hash.address);
+        if (it == track.end()) continue;
+        double expected = startMs + hash.anchorTimeMs;
+        hits += std::any_of(it->second.begin(), it->second.end(),
+                            [&](uint32_t time) { return std::abs(time - expected) <= HASH_TOLERANCE_MS; });
+    }
+    return hits;
+}
+
+static size_t distinctAddresses(const std::vector<FingerprintHash>& hashes) {
+    std::unordered_set<uint32_t> addresses;
+    for (const FingerprintHash& hash : hashes) addresses.insert(hash.address);
+    return addresses.size();
+}
+
+static bool hashesSection() {
+    const double trackSeconds = 60.0, clipSeconds = 8.0;
+    const size_t clipCount = 10;
+    std::vector<double> track = synthTrack(trackSeconds, 24);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<FingerprintHash> timed = fingerprint(track);
+    double pipelineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    SchemeHashes reference = fingerprintBoth(track);
+    auto v1Times = addressTimes(reference.v1), v2Times = addressTimes(reference.v2);
+    std::cout << "hashes: " << clipCount << " clips of " << clipSeconds << " s from a " << trackSeconds << " s track" << std::endl;
+    std::cout << "  distinct addresses in the track: v1 " << distinctAddresses(reference.v1) << ", v2 "
+              << distinctAddresses(reference.v2) << " of " << reference.v2.size() << " couples" << std::endl;
+    std::cout << "  v2 pipeline (resample, spectrogram, peaks, hashes): " << pipelineMs << " ms, "
+              << timed.size() << " couples" << std::endl;
+
+    std::mt19937 random(24);
+    size_t clipLength = static_cast<size_t>(BENCH_SAMPLE_RATE * clipSeconds);
+    bool passed = true;
+    for (double noise : {0.0, 1.0, 3.3}) {
+        std::normal_distribution<double> gaussian(0.0, noise);
+        size_t v1Hits = 0, v1Chance = 0, v1Total = 0, v2Hits = 0, v2Chance = 0, v2Total = 0;
+        for (size_t c = 0; c < clipCount; c++) {
+            size_t first = random() % (track.size() - clipLength);
+            std::vector<double> clip(track.begin() + first, track.begin() + first + clipLength);
+            if (noise > 0.0) {
+                for (double& sample : clip) sample += gaussian(random);
+            }
+            double startMs = first * 1000.0 / BENCH_SAMPLE_RATE;
+            SchemeHashes hashes = fingerprintBoth(clip);
+            double wrongMs = startMs + (startMs < HASH_CHANCE_SHIFT_MS ? HASH_CHANCE_SHIFT_MS : -HASH_CHANCE_SHIFT_MS);
+            v1Hits += alignedHits(v1Times, hashes.v1, startMs);
+            v2Hits += alignedHits(v2Times, hashes.v2, startMs);
+            v1Chance += alignedHits(v1Times, hashes.v1, wrongMs);
+            v2Chance += alignedHits(v2Times, hashes.v2, wrongMs);
+            v1Total += hashes.v1.size();
+            v2Total += hashes.v2.size();
+        }
+        double v1Recall = static_cast<double>(v1Hits) / std::max<size_t>(v1Total, 1);
+        double v2Recall = static_cast<double>(v2Hits) / std::max<size_t>(v2Total, 1);
+        double v1ChanceRate = static_cast<double>(v1Chance) / std::max<size_t>(v1Total, 1);
+        double v2ChanceRate = static_cast<double>(v2Chance) / std::max<size_t>(v2Total, 1);
+        std::cout << "  noise sd " << noise << ": recall v1 " << v1Recall << " (chance " << v1ChanceRate << "), v2 "
+                  << v2Recall << " (chance " << v2ChanceRate << ")" << std::endl;
+        passed = passed && v2Recall - v2ChanceRate >= v1Recall - v1ChanceRate;
+    }
+    return passed;
+}
+
+
+
+// ---------------------------------------------------------------------------
+// motif: top-1 matches on repetitive tracks with every repeat of an address
+// kept, against one couple per address (the last one), as fingerprints were
+// stored before they became a flat list. Both sides go through the same
+// offset histogram on the in-memory backend. FindMatch runs on the full
+// catalog too and must agree with it: its candidate cut-off only saves time.
+
+// A motif of notes of one or two tones, 2-4 s long, looped for the whole track
+static std::vector<double> motifTrack(double seconds, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> pitch(24.0, 60.0);  // Semitones above 110 Hz
+    size_t notes = 6 + random() % 5;
+    size_t noteLength = BENCH_SAMPLE_RATE * (2000 + random() % 2000) / 1000 / notes;
+    std::vector<double> motif(notes * noteLength);
+    for (size_t note = 0; note < notes; note++) {
+        size_t tones = 1 + random() % 2;
+        for (size_t tone = 0; tone < tones; tone++) {
+            double frequency = 110.0 * std::pow(2.0, pitch(random) / 12.0);
+            for (size_t n = 0; n < noteLength; n++) {
+                double envelope = std::min(1.0, std::min(n, noteLength - n) / (0.01 * BENCH_SAMPLE_RATE));
+                motif[note * noteLength + n] += 0.3 * envelope * std::sin(2 * M_PI * frequency * n / BENCH_SAMPLE_RATE);
+            }
+        }
+    }
+
+    std::vector<double> samples(static_cast<size_t>(BENCH_SAMPLE_RATE * seconds));
+    for (size_t n = 0; n < samples.size(); n++) samples[n] = motif[n % motif.size()];
+    return samples;
+}
+
+static std::vector<FingerprintHash> onePerAddress(const std::vector<FingerprintHash>& hashes) {
+    std::vector<FingerprintHash> kept;
+    for (const auto& [address, time] : lastTimes(hashes)) kept.push_back({address, time});
+    return kept;
+}
+
+// The song with the highest offset histogram peak over every pair of clip and
+// stored times of an address, 0 when nothing matches
+static uint32_t topSong(DBClient& db, const std::vector<FingerprintHash>& clip) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> clipTimes = addressTimes(clip);
+    std::vector<uint32_t> addresses;
+    for (const auto& entry : clipTimes) addresses.push_back(entry.first);
+    std::sort(addresses.begin(), addresses.end());
+
+    CoupleTable table = db.GetCouples(addresses);
+    std::map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> times;  // In song ID order
+    for (size_t i = 0; i < table.size(); i++) {
+        for (const Couple* couple = table.CouplesBegin(i); couple != table.CouplesEnd(i); ++couple) {
+            for (uint32_t clipTime : clipTimes[table.addresses[i]]) {
+                times[couple->songID].emplace_back(clipTime, couple->anchorTimeMs);
+            }
+        }
+    }
+
+    uint32_t best = 0;
+    double bestScore = 0.0;
+    for (const auto& [songID, songTimes] : times) {
+        double score = scoreOffsets(songTimes).score;
+        if (score > bestScore) {
+            best = songID;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+static bool motifSection() {
+    const size_t trackCount = 40, queryCount = 80;
+    const double noise = 3.0;
+    std::vector<std::vector<double>> tracks;
+    MemoryClient allPairs, lastPair;
+    allPairs.Connect();
+    lastPair.Connect();
+    for (size_t t = 0; t < trackCount; t++) {
+        tracks.push_back(motifTrack(30.0, 200 + static_cast<unsigned>(t)));
+        std::vector<FingerprintHash> hashes = fingerprint(tracks.back());
+        uint32_t songID = allPairs.RegisterSong("motif " + std::to_string(t), "fingerprint-bench");
+        lastPair.LoadSong(songID, Song{"motif " + std::to_string(t), "fingerprint-bench"});
+        allPairs.StoreFingerprints(songID, hashes);
+        lastPair.StoreFingerprints(songID, onePerAddress(hashes));
+    }
+
+    size_t allCorrect = 0, lastCorrect = 0, findMatchCorrect = 0;
+    for (const Query& query : synthQueries(tracks, queryCount, 5.0, noise, 20)) {
+        std::vector<FingerprintHash> hashes = fingerprint(query.clip);
+        allCorrect += topSong(allPairs, hashes) == query.songID;
+        lastCorrect += topSong(lastPair, onePerAddress(hashes)) == query.songID;
+        std::vector<Match> matches = FindMatch(allPairs, query.clip, BENCH_SAMPLE_RATE, nullptr, 1);
+        findMatchCorrect += !matches.empty() && matches[0].songID == query.songID;
+    }
+
+    std::cout << "motif: " << queryCount << " queries of 5 s, noise sd " << noise << ", over " << trackCount
+              << " looped tracks" << std::endl;
+    std::cout << "  top-1 correct: one couple per address " << lastCorrect << ", all pairs " << allCorrect
+              << " (FindMatch " << findMatchCorrect << ")" << std::endl;
+    return allCorrect >= lastCorrect && findMatchCorrect == allCorrect;
+}
+
+
+int main(int argc, char** argv) {
+    struct Section {
+        const char* name;
+        bool (*run)();
+    };
+    const Section sections[] = {
+        {"scorer", scorerSection},
+        {"hashes", hashesSection},
+        {"motif", motifSection},
+    };
+
+    bool passed = true;
+    bool found = false;
+    for (const Section& section : sections) {
+        if (argc > 1 && std::strcmp(argv[1], section.name) != 0) continue;
+        found = true;
+        passed = section.run() && passed;
+    }
+    if (!found) {
+        std::cerr << "Unknown section " << argv[1] << std::endl;
+        return 1;
+    }
+    return passed ? 0 : 1;
+}
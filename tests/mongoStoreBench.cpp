@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <mongocxx/client.hpp>
+#include <header/mongo.h>
+
+
+// Ingest write throughput against a real mongod: the one upsert per address
+// that StoreFingerprints used to send, against the grouped, unordered bulk
+// upserts it sends now. Opt-in, since it needs a server: set
+// MONGO_BENCH_URI (e.g. mongodb://localhost:27017). Without it, or when the
+// server does not answer, the benchmark reports itself skipped.
+// Everything is written to a scratch database that is dropped afterwards.
+
+#define BENCH_SKIPPED 77
+#define BENCH_DATABASE "song-recognition-bench"
+#define BENCH_TRACKS 4
+#define BENCH_HASHES_PER_TRACK 20000
+
+using BenchClock = std::chrono::steady_clock;
+
+
+// The write path before bulk upserts, kept as the reference
+static void storeOneByOne(mongocxx::collection& collection, uint32_t songID,
+                          const std::vector<FingerprintHash>& fingerprints) {
+    using namespace bsoncxx::builder::stream;
+    mongocxx::options::update options;
+    options.upsert(true);
+    for (const FingerprintHash& hash : fingerprints) {
+        auto filter = document{} << "_id" << static_cast<int64_t>(hash.address) << finalize;
+        auto update = document{} << "$push" << open_document
+                                 << "couples" << open_document
+                                 << "anchorTimeMs" << static_cast<int64_t>(hash.anchorTimeMs)
+                                 << "songID" << static_cast<int64_t>(songID)
+                                 << close_document
+                                 << close_document << finalize;
+        collection.update_one(filter.view(), update.view(), options);
+    }
+}
+
+// Tracks of random addresses, a few of them repeated within the track the way
+// real fingerprints repeat
+static std::vector<std::vector<FingerprintHash>> syntheticTracks() {
+    std::mt19937 random(8);
+    std::vector<std::vector<FingerprintHash>> tracks(BENCH_TRACKS);
+    for (auto& track : tracks) {
+        for (uint32_t i = 0; i < BENCH_HASHES_PER_TRACK; i++) {
+            uint32_t address = i % 16 == 0 && !track.empty() ? track[random() % track.size()].address
+                                                             : static_cast<uint32_t>(random());
+            track.push_back({address, i * 3});
+        }
+    }
+    return tracks;
+}
+
+static double seconds(BenchClock::time_point start) {
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+
+int main() {
+    const char* uri = std::getenv("MONGO_BENCH_URI");
+    if (!uri || !*uri) {
+        std::cout << "MONGO_BENCH_URI is not set, skipping" << std::endl;
+        return BENCH_SKIPPED;
+    }
+
+    MongoClient client(std::string(uri), BENCH_DATABASE);
+    if (!client.Connect()) {
+        std::cout << "No mongod reachable at " << uri << ", skipping" << std::endl;
+        return BENCH_SKIPPED;
+    }
+
+    mongocxx::client raw{mongocxx::uri{uri}};
+    auto database = raw[BENCH_DATABASE];
+    auto collection = database[FingerprintCollectionName(false)];
+    auto tracks = syntheticTracks();
+    size_t couples = BENCH_TRACKS * BENCH_HASHES_PER_TRACK;
+
+    collection.drop();
+    auto start = BenchClock::now();
+    for (size_t t = 0; t < tracks.size(); t++) {
+        storeOneByOne(collection, static_cast<uint32_t>(t + 1), tracks[t]);
+    }
+    double oneByOne = seconds(start);
+    int64_t oneByOneDocuments = collection.count_documents({});
+
+    collection.drop();
+    bool stored = true;
+    start = BenchClock::now();
+    for (size_t t = 0; t < tracks.size(); t++) {
+        stored = client.StoreFingerprints(static_cast<uint32_t>(t + 1), tracks[t]) && stored;
+    }
+    double bulk = seconds(start);
+    int64_t bulkDocuments = collection.count_documents({});
+    database.drop();
+
+    std::cout << couples << " couples in " << BENCH_TRACKS << " tracks" << std::endl;
+    std::cout << "  one upsert per address: " << oneByOne << " s, " << couples / oneByOne << " couples/s" << std::endl;
+    std::cout << "  bulk upserts:           " << bulk << " s, " << couples / bulk << " couples/s" << std::endl;
+    std::cout << "  speedup: " << oneByOne / bulk << "x" << std::endl;
+
+    if (!stored || bulkDocuments != oneByOneDocuments) {
+        std::cerr << "Bulk upserts wrote " << bulkDocuments << " addresses, one by one wrote "
+                  << oneByOneDocuments << std::endl;
+        return 1;
+    }
+    return 0;
+}